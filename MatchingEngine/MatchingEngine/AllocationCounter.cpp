@@ -0,0 +1,199 @@
+#include "AllocationCounter.h"
+
+// the global allocation functions are only replaced in test builds, so that the
+// engine shipped doesn't go through the counter
+#ifdef MATCHINGENGINE_COUNT_ALLOCATIONS
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace matchingengine {
+
+namespace {
+
+std::atomic<bool> g_counting(false);
+std::atomic<std::size_t> g_allocations(0);
+
+void* countedAllocate(std::size_t bytes)
+{
+    if (g_counting.load(std::memory_order_relaxed)) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    void* p = std::malloc(bytes == 0 ? 1 : bytes);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+#ifdef __cpp_aligned_new
+void* countedAllocateAligned(std::size_t bytes, std::align_val_t alignment)
+{
+    if (g_counting.load(std::memory_order_relaxed)) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    std::size_t align = static_cast<std::size_t>(alignment);
+    // aligned_alloc wants a multiple of the alignment
+    std::size_t size = (bytes == 0 ? 1 : bytes + align - 1) / align * align;
+#ifdef _MSC_VER
+    void* p = _aligned_malloc(size, align);
+#else
+    void* p = std::aligned_alloc(align, size);
+#endif
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void freeAligned(void* p)
+{
+#ifdef _MSC_VER
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+#endif // __cpp_aligned_new
+
+} // namespace
+
+
+void AllocationCounter::start()
+{
+    g_allocations.store(0, std::memory_order_relaxed);
+    g_counting.store(true, std::memory_order_relaxed);
+}
+
+
+std::size_t AllocationCounter::stop()
+{
+    g_counting.store(false, std::memory_order_relaxed);
+    return g_allocations.load(std::memory_order_relaxed);
+}
+
+} // namespace matchingengine
+
+
+void* operator new(std::size_t bytes)
+{
+    return matchingengine::countedAllocate(bytes);
+}
+
+
+void* operator new[](std::size_t bytes)
+{
+    return matchingengine::countedAllocate(bytes);
+}
+
+
+void* operator new(std::size_t bytes, const std::nothrow_t&) noexcept
+{
+    try {
+        return matchingengine::countedAllocate(bytes);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+
+void* operator new[](std::size_t bytes, const std::nothrow_t&) noexcept
+{
+    try {
+        return matchingengine::countedAllocate(bytes);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+
+#ifdef __cpp_aligned_new
+// over-aligned types, C++17 on, are counted too
+
+void* operator new(std::size_t bytes, std::align_val_t alignment)
+{
+    return matchingengine::countedAllocateAligned(bytes, alignment);
+}
+
+
+void* operator new[](std::size_t bytes, std::align_val_t alignment)
+{
+    return matchingengine::countedAllocateAligned(bytes, alignment);
+}
+
+
+void* operator new(std::size_t bytes, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    try {
+        return matchingengine::countedAllocateAligned(bytes, alignment);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+
+void* operator new[](std::size_t bytes, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    try {
+        return matchingengine::countedAllocateAligned(bytes, alignment);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    matchingengine::freeAligned(p);
+}
+
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+    matchingengine::freeAligned(p);
+}
+
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+    matchingengine::freeAligned(p);
+}
+
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept
+{
+    matchingengine::freeAligned(p);
+}
+
+#endif // __cpp_aligned_new
+
+#endif // MATCHINGENGINE_COUNT_ALLOCATIONS
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+namespace matchingengine {
+
+/// <summary>
+/// Counts calls to the global operator new between start() and stop(), by
+/// replacing the global allocation functions; used by the zero-allocation test.
+/// Only built with MATCHINGENGINE_COUNT_ALLOCATIONS defined, as in the Debug
+/// configurations, so that release builds keep the standard allocator
+/// </summary>
+class AllocationCounter
+{
+public:
+    /// <summary>
+    /// reset the count and start counting allocations
+    /// </summary>
+    static void start();
+
+    /// <summary>
+    /// stop counting, returns the number of allocations since start()
+    /// </summary>
+    static std::size_t stop();
+};
+
+} // namespace matchingengine
@@ -0,0 +1,231 @@
+#include "DifferentialFuzzer.h"
+#include "MessageProcessor.h"
+#include "NullBuffer.h"
+#include "ReferenceMessageProcessor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <random>
+#include <sstream>
+
+
+namespace matchingengine {
+
+
+std::vector<std::string> DifferentialFuzzer::makeCommands(unsigned seed, std::size_t numCommands)
+{
+    static const char* const oddNumbers[] = { "0", "-5", "+7", "12abc", "abc", "2147483648",
+        "-2147483648", "2147483647", " 9", "\t8", "99999999999999999999", "" };
+    static const char* const malformed[] = { "", "BUY GFD 100 10", "SELL  GFD 100 10 x", "PRINT extra",
+        "CANCEL", "CANCEL a b", "BUY GFD 100 10 m0-o1 ", " PRINT", "GARBAGE", "MASSCANCEL",
+        "MASSCANCEL SIDE", "MASSCANCEL SIDE BUY NOTDETAIL", "MASSCANCEL PRICE BUY 100", "MASSCANCEL PREFIX" };
+
+    std::mt19937 random(seed);
+    auto pick = [&random](std::size_t n) { return static_cast<std::size_t>(random() % n); };
+    auto side = [&]() { return std::string(pick(2) ? "BUY" : "SELL"); };
+    auto price = [&]() {
+        return pick(10) ? std::to_string(95 + pick(11)) : std::string(oddNumbers[pick(sizeof(oddNumbers) / sizeof(*oddNumbers))]);
+    };
+    // no quantity is further from 0 than this, so even if every order of the stream
+    // rests on one level, the level's total still fits in Quantity; MODIFY lets
+    // negative quantities rest, and trading against them adds up too
+    const Quantity largestQuantity = std::numeric_limits<Quantity>::max() /
+        static_cast<Quantity>(std::max<std::size_t>(numCommands, 1));
+    auto quantity = [&]() {
+        if (pick(10)) {
+            return std::to_string(1 + pick(30));
+        }
+        std::string oddNumber = oddNumbers[pick(sizeof(oddNumbers) / sizeof(*oddNumbers))];
+        if (oddNumber == "2147483647") {
+            return std::to_string(largestQuantity);
+        }
+        if (oddNumber == "-2147483648") {
+            return std::to_string(-largestQuantity);
+        }
+        return oddNumber;
+    };
+    auto detail = [&]() { return std::string(pick(2) ? " DETAIL" : ""); };
+
+    std::vector<std::string> commands;
+    std::vector<std::string> orderIds;
+    for (std::size_t i = 0; i < numCommands; ++i) {
+        const std::size_t action = pick(100);
+        if (action < 45 || orderIds.empty()) {
+            // owner tag, then a short or a heap allocated ID, sometimes a duplicate
+            std::string orderId = "m" + std::to_string(pick(5)) + "-" + (pick(2) ? "o" : "averyveryverylongorderidentifier") + std::to_string(i);
+            if (!orderIds.empty() && pick(30) == 0) {
+                orderId = orderIds[pick(orderIds.size())];
+            }
+            orderIds.push_back(orderId);
+            const char* type = pick(4) == 0 ? "IOC" : (pick(30) == 0 ? "XXX" : "GFD");
+            commands.push_back(side() + " " + type + " " + price() + " " + quantity() + " " + orderId);
+        }
+        else if (action < 55) {
+            // aggressive order sweeping several levels
+            commands.push_back(side() + " " + (pick(2) ? "GFD" : "IOC") + " " + std::to_string(85 + pick(31)) + " "
+                + std::to_string(20 + pick(400)) + " sweep" + std::to_string(i));
+        }
+        else if (action < 67) {
+            commands.push_back("CANCEL " + orderIds[pick(orderIds.size())]);
+        }
+        else if (action < 82) {
+            commands.push_back("MODIFY " + orderIds[pick(orderIds.size())] + " " + (pick(20) ? side() : "BAD") + " " + price() + " " + quantity());
+        }
+        else if (action < 89) {
+            commands.push_back("PRINT");
+        }
+        else if (action < 93) {
+            commands.push_back(malformed[pick(sizeof(malformed) / sizeof(*malformed))]);
+        }
+        else if (action < 95) {
+            commands.push_back("MASSCANCEL SIDE " + side() + detail());
+        }
+        else if (action < 98) {
+            commands.push_back("MASSCANCEL PRICE " + side() + " " + price() + " " + price() + detail());
+        }
+        else {
+            commands.push_back("MASSCANCEL PREFIX m" + std::to_string(pick(5)) + (pick(4) ? "-" : "-a") + detail());
+        }
+    }
+    return commands;
+}
+
+
+/// <summary>
+/// execute one command, then PRINT, returns everything the engine wrote
+/// </summary>
+template <typename Processor>
+static std::string runCommand(const Processor& messageProcessor,
+    const MatchingEngineI& matchingEngineI,
+    const std::string& command)
+{
+    std::ostringstream os;
+    std::streambuf* coutBuffer = std::cout.rdbuf(os.rdbuf());
+    messageProcessor.processMessage(command);
+    matchingEngineI.print();
+    std::cout.rdbuf(coutBuffer);
+    return os.str();
+}
+
+
+std::size_t DifferentialFuzzer::findDivergence(const std::vector<std::string>& commands,
+    std::string& expected,
+    std::string& actual) const
+{
+    std::shared_ptr<MatchingEngineI> reference = m_referenceFactory();
+    std::shared_ptr<MatchingEngineI> candidate = m_candidateFactory();
+    // the reference side parses with the original tokenizer and std::stoi
+    reference::ReferenceMessageProcessor referenceProcessor(reference);
+    MessageProcessor candidateProcessor(candidate);
+
+    for (std::size_t i = 0; i < commands.size(); ++i) {
+        expected = runCommand(referenceProcessor, *reference, commands[i]);
+        actual = runCommand(candidateProcessor, *candidate, commands[i]);
+        if (expected != actual) {
+            return i;
+        }
+    }
+    return commands.size();
+}
+
+
+bool DifferentialFuzzer::diverges(const std::vector<std::string>& commands) const
+{
+    std::string expected;
+    std::string actual;
+    return findDivergence(commands, expected, actual) < commands.size();
+}
+
+
+std::vector<std::string> DifferentialFuzzer::shrink(std::vector<std::string> commands) const
+{
+    std::string expected;
+    std::string actual;
+    std::size_t divergence = findDivergence(commands, expected, actual);
+    if (divergence == commands.size()) {
+        return commands;
+    }
+    // nothing after the first divergence matters
+    commands.resize(divergence + 1);
+
+    // try dropping chunks of commands, halving the chunk size down to single commands
+    for (std::size_t chunkSize = commands.size() / 2; chunkSize > 0; chunkSize /= 2) {
+        for (std::size_t chunkBegin = 0; chunkBegin < commands.size();) {
+            std::vector<std::string> smaller(commands.cbegin(), commands.cbegin() + chunkBegin);
+            std::size_t chunkEnd = std::min(chunkBegin + chunkSize, commands.size());
+            smaller.insert(smaller.end(), commands.cbegin() + chunkEnd, commands.cend());
+
+            if (!smaller.empty() && diverges(smaller)) {
+                commands.swap(smaller);
+            }
+            else {
+                chunkBegin += chunkSize;
+            }
+        }
+    }
+    return commands;
+}
+
+
+bool DifferentialFuzzer::run(unsigned firstSeed, std::size_t numRuns, std::size_t numCommands, std::ostream& os) const
+{
+    for (unsigned seed = firstSeed; seed < firstSeed + numRuns; ++seed) {
+        std::vector<std::string> commands = makeCommands(seed, numCommands);
+        if (!diverges(commands)) {
+            continue;
+        }
+
+        std::vector<std::string> reproducer = shrink(commands);
+        std::string expected;
+        std::string actual;
+        findDivergence(reproducer, expected, actual);
+
+        os << "seed " << seed << " diverges, shrunk from " << commands.size()
+            << " to " << reproducer.size() << " commands:\n";
+        for (const auto& command : reproducer) {
+            os << "  " << command << "\n";
+        }
+        os << "reference:\n" << expected << "candidate:\n" << actual;
+        return false;
+    }
+
+    os << numRuns << " runs of " << numCommands << " commands agree\n";
+    return true;
+}
+
+
+/// <summary>
+/// returns the commands per second engineFactory's engine executes, output discarded
+/// </summary>
+static double measureThroughput(const DifferentialFuzzer::EngineFactory& engineFactory,
+    const std::vector<std::string>& commands)
+{
+    using Clock = std::chrono::steady_clock;
+
+    MessageProcessor messageProcessor(engineFactory());
+    NullBuffer nullBuffer;
+    std::streambuf* coutBuffer = std::cout.rdbuf(&nullBuffer);
+
+    const Clock::time_point start = Clock::now();
+    for (const auto& command : commands) {
+        messageProcessor.processMessage(command);
+    }
+    const double elapsedSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::cout.rdbuf(coutBuffer);
+    return elapsedSeconds > 0 ? commands.size() / elapsedSeconds : 0;
+}
+
+
+void DifferentialFuzzer::compareThroughput(const std::vector<std::string>& commands, std::ostream& os) const
+{
+    const double referenceRate = measureThroughput(m_referenceFactory, commands);
+    const double candidateRate = measureThroughput(m_candidateFactory, commands);
+
+    os << "throughput over " << commands.size() << " commands: reference "
+        << referenceRate << " cmd/s, candidate " << candidateRate << " cmd/s, candidate/reference "
+        << (referenceRate > 0 ? candidateRate / referenceRate : 0) << "x\n";
+}
+
+} // namespace matchingengine
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "MatchingEngineI.h"
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace matchingengine {
+
+/// <summary>
+/// Differential fuzzer: feeds the same seeded random command streams to a reference
+/// engine through the original ReferenceMessageProcessor and to a candidate engine
+/// through MessageProcessor, and compares their events and depth (PRINT) after every
+/// command. A diverging stream is shrunk to a short reproducer. Also reports the
+/// throughput of both engines side by side, both through MessageProcessor
+/// </summary>
+class DifferentialFuzzer
+{
+public:
+    using EngineFactory = std::function<std::shared_ptr<MatchingEngineI>()>;
+
+    /// <summary>
+    /// ctor, inject factories for fresh reference and candidate engines
+    /// </summary>
+    DifferentialFuzzer(EngineFactory referenceFactory, EngineFactory candidateFactory) :
+        m_referenceFactory(std::move(referenceFactory)),
+        m_candidateFactory(std::move(candidateFactory)) {}
+
+    /// <summary>
+    /// generate a random command stream from seed, biased towards crossing prices,
+    /// sweeps, modifies to odd quantities, mass cancels and malformed messages;
+    /// quantities are kept low enough that no level's total overflows Quantity
+    /// </summary>
+    static std::vector<std::string> makeCommands(unsigned seed, std::size_t numCommands);
+
+    /// <summary>
+    /// run commands on a fresh reference and candidate engine; returns the index of the
+    /// first command after which their output differs, and the two outputs of that
+    /// command, or commands.size() if they agree throughout
+    /// </summary>
+    std::size_t findDivergence(const std::vector<std::string>& commands,
+        std::string& expected,
+        std::string& actual) const;
+
+    /// <summary>
+    /// shrink a diverging command stream to a shorter one that still diverges
+    /// </summary>
+    std::vector<std::string> shrink(std::vector<std::string> commands) const;
+
+    /// <summary>
+    /// fuzz numRuns streams of numCommands commands, seeds from firstSeed on, and
+    /// report the first divergence shrunk; function returns true if all agree, o.w. false
+    /// </summary>
+    bool run(unsigned firstSeed, std::size_t numRuns, std::size_t numCommands, std::ostream& os) const;
+
+    /// <summary>
+    /// time both engines on commands, output discarded, and report their throughput
+    /// </summary>
+    void compareThroughput(const std::vector<std::string>& commands, std::ostream& os) const;
+
+private:
+    EngineFactory m_referenceFactory;
+    EngineFactory m_candidateFactory;
+
+    /// <summary>
+    /// returns true if commands make the engines diverge
+    /// </summary>
+    bool diverges(const std::vector<std::string>& commands) const;
+};
+
+} // namespace matchingengine
@@ -0,0 +1,198 @@
+#include "LoadGenerator.h"
+#include "MessageProcessor.h"
+#include "NullBuffer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <random>
+
+
+namespace matchingengine {
+
+
+std::vector<TimedMessage> LoadGenerator::loadCapture(std::istream& is)
+{
+    std::vector<TimedMessage> stream;
+    std::string line;
+    while (getline(is, line, '\n')) {
+        std::size_t delimiter = line.find(' ');
+        if (delimiter == std::string::npos) {
+            continue;
+        }
+        try {
+            stream.push_back(TimedMessage{ std::stoll(line.substr(0, delimiter)), line.substr(delimiter + 1) });
+        }
+        catch (...) {
+            // not a timestamped line, skip it
+        }
+    }
+    return stream;
+}
+
+
+void LoadGenerator::saveCapture(const std::vector<TimedMessage>& stream, std::ostream& os)
+{
+    for (const auto& timedMessage : stream) {
+        os << timedMessage.m_sendTimeNs << " " << timedMessage.m_message << "\n";
+    }
+}
+
+
+std::vector<TimedMessage> LoadGenerator::makeSyntheticStream(std::size_t numMessages,
+    double ratePerSecond,
+    unsigned seed)
+{
+    const Price basePrice = 1000;
+    const int priceBand = 50;
+
+    std::mt19937 random(seed);
+    std::exponential_distribution<double> interArrivalNs(ratePerSecond / 1e9);
+    std::vector<TimedMessage> stream;
+    std::vector<std::string> orderIds;
+    stream.reserve(numMessages);
+
+    double sendTimeNs = 0;
+    for (std::size_t i = 0; i < numMessages; ++i) {
+        const int action = random() % 100;
+        const std::string side = random() % 2 ? "BUY" : "SELL";
+        const std::string price = std::to_string(basePrice + static_cast<int>(random() % (2 * priceBand + 1)) - priceBand);
+        const std::string quantity = std::to_string(1 + random() % 100);
+
+        std::string message;
+        if (action < 60 || orderIds.empty()) {
+            orderIds.push_back("participant-" + std::to_string(random() % 1000) + "-order-" + std::to_string(i));
+            const std::string type = random() % 4 ? "GFD" : "IOC";
+            message = side + " " + type + " " + price + " " + quantity + " " + orderIds.back();
+        }
+        else if (action < 80) {
+            message = "CANCEL " + orderIds[random() % orderIds.size()];
+        }
+        else if (action < 97) {
+            message = "MODIFY " + orderIds[random() % orderIds.size()] + " " + side + " " + price + " " + quantity;
+        }
+        else if (action < 99) {
+            message = "PRINT";
+        }
+        else {
+            // a participant disconnects
+            message = "MASSCANCEL PREFIX participant-" + std::to_string(random() % 1000) + "-";
+        }
+
+        stream.push_back(TimedMessage{ static_cast<long long>(sendTimeNs), std::move(message) });
+        sendTimeNs += interArrivalNs(random);
+    }
+    return stream;
+}
+
+
+double LoadGenerator::recordedRate(const std::vector<TimedMessage>& stream)
+{
+    if (stream.size() < 2 || stream.back().m_sendTimeNs <= stream.front().m_sendTimeNs) {
+        return 0;
+    }
+    return (stream.size() - 1) * 1e9 / (stream.back().m_sendTimeNs - stream.front().m_sendTimeNs);
+}
+
+
+/// <summary>
+/// returns the latency at quantile q of sorted latencies
+/// </summary>
+static long long percentile(const std::vector<long long>& sortedLatencies, double q)
+{
+    if (sortedLatencies.empty()) {
+        return 0;
+    }
+    std::size_t index = static_cast<std::size_t>(q * (sortedLatencies.size() - 1) + 0.5);
+    return sortedLatencies[index];
+}
+
+
+LatencyReport LoadGenerator::replay(const std::vector<TimedMessage>& stream,
+    double rateScale,
+    const EngineFactory& engineFactory)
+{
+    using Clock = std::chrono::steady_clock;
+
+    MessageProcessor messageProcessor(engineFactory());
+    std::vector<long long> latencies(stream.size());
+
+    NullBuffer nullBuffer;
+    std::streambuf* coutBuffer = std::cout.rdbuf(&nullBuffer);
+
+    const long long firstSendTimeNs = stream.empty() ? 0 : stream.front().m_sendTimeNs;
+    const Clock::time_point start = Clock::now();
+    for (std::size_t i = 0; i < stream.size(); ++i) {
+        const Clock::time_point intendedSendTime = start + std::chrono::nanoseconds(
+            static_cast<long long>((stream[i].m_sendTimeNs - firstSendTimeNs) / rateScale));
+
+        // open loop: wait for the schedule if ahead of it, never wait for the engine;
+        // when behind, the message is late and its latency includes that delay
+        while (Clock::now() < intendedSendTime) {
+        }
+
+        messageProcessor.processMessage(stream[i].m_message);
+
+        latencies[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - intendedSendTime).count();
+    }
+    const Clock::time_point end = Clock::now();
+
+    std::cout.rdbuf(coutBuffer);
+
+    LatencyReport report;
+    report.m_numMessages = stream.size();
+    report.m_offeredRate = recordedRate(stream) * rateScale;
+    const double elapsedSeconds = std::chrono::duration<double>(end - start).count();
+    report.m_achievedRate = elapsedSeconds > 0 ? stream.size() / elapsedSeconds : 0;
+
+    std::sort(latencies.begin(), latencies.end());
+    report.m_p50Ns = percentile(latencies, 0.5);
+    report.m_p99Ns = percentile(latencies, 0.99);
+    report.m_p999Ns = percentile(latencies, 0.999);
+    report.m_maxNs = latencies.empty() ? 0 : latencies.back();
+    return report;
+}
+
+
+std::vector<LatencyReport> LoadGenerator::sweep(const std::vector<TimedMessage>& stream,
+    const std::vector<double>& offeredRates,
+    const EngineFactory& engineFactory)
+{
+    std::vector<LatencyReport> reports;
+    const double rate = recordedRate(stream);
+    if (rate <= 0) {
+        return reports;
+    }
+
+    for (double offeredRate : offeredRates) {
+        reports.push_back(replay(stream, offeredRate / rate, engineFactory));
+    }
+    return reports;
+}
+
+
+void LoadGenerator::printReports(const std::vector<LatencyReport>& reports, std::ostream& os)
+{
+    os << std::setw(14) << "offered/s"
+        << std::setw(14) << "achieved/s"
+        << std::setw(12) << "p50 us"
+        << std::setw(12) << "p99 us"
+        << std::setw(12) << "p99.9 us"
+        << std::setw(12) << "max us"
+        << "\n";
+
+    os << std::fixed << std::setprecision(1);
+    for (const auto& report : reports) {
+        os << std::setw(14) << report.m_offeredRate
+            << std::setw(14) << report.m_achievedRate
+            << std::setw(12) << report.m_p50Ns / 1e3
+            << std::setw(12) << report.m_p99Ns / 1e3
+            << std::setw(12) << report.m_p999Ns / 1e3
+            << std::setw(12) << report.m_maxNs / 1e3
+            << "\n";
+    }
+    os.unsetf(std::ios_base::floatfield);
+    os << std::setprecision(6);
+}
+
+} // namespace matchingengine
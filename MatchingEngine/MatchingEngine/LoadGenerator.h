@@ -0,0 +1,92 @@
+#pragma once
+
+#include "MatchingEngineI.h"
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace matchingengine {
+
+/// <summary>
+/// one message of a replay stream and the time it is meant to be sent,
+/// in nanoseconds since the start of the stream
+/// </summary>
+struct TimedMessage {
+    long long   m_sendTimeNs;
+    std::string m_message;
+};
+
+/// <summary>
+/// latency distribution of one replay at one offered load
+/// </summary>
+struct LatencyReport {
+    double      m_offeredRate;   // messages per second asked for
+    double      m_achievedRate;  // messages per second actually processed
+    std::size_t m_numMessages;
+    long long   m_p50Ns;
+    long long   m_p99Ns;
+    long long   m_p999Ns;
+    long long   m_maxNs;
+};
+
+
+/// <summary>
+/// Open-loop load generator: replays a timestamped stream into a MessageProcessor
+/// at its recorded inter-arrival times, optionally scaled. Each message's latency is
+/// measured from its intended send time, not from when it was actually handed over,
+/// so a stalled engine is charged for the queueing delay it causes to the messages
+/// behind it (coordinated-omission correction)
+/// </summary>
+class LoadGenerator
+{
+public:
+    using EngineFactory = std::function<std::shared_ptr<MatchingEngineI>()>;
+
+    /// <summary>
+    /// read a captured stream, one "sendTimeNs message" per line
+    /// </summary>
+    static std::vector<TimedMessage> loadCapture(std::istream& is);
+
+    /// <summary>
+    /// write a stream in the format read by loadCapture()
+    /// </summary>
+    static void saveCapture(const std::vector<TimedMessage>& stream, std::ostream& os);
+
+    /// <summary>
+    /// generate a random stream of new orders, cancels, modifies, prints and mass
+    /// cancels with Poisson arrivals at ratePerSecond, reproducible from seed
+    /// </summary>
+    static std::vector<TimedMessage> makeSyntheticStream(std::size_t numMessages,
+        double ratePerSecond,
+        unsigned seed);
+
+    /// <summary>
+    /// returns the rate of a stream in messages per second as recorded
+    /// </summary>
+    static double recordedRate(const std::vector<TimedMessage>& stream);
+
+    /// <summary>
+    /// replay stream into a fresh engine from engineFactory, rateScale times faster
+    /// than recorded; engine output is discarded while replaying
+    /// </summary>
+    static LatencyReport replay(const std::vector<TimedMessage>& stream,
+        double rateScale,
+        const EngineFactory& engineFactory);
+
+    /// <summary>
+    /// replay stream once per offered rate, giving latency vs offered load
+    /// </summary>
+    static std::vector<LatencyReport> sweep(const std::vector<TimedMessage>& stream,
+        const std::vector<double>& offeredRates,
+        const EngineFactory& engineFactory);
+
+    /// <summary>
+    /// print reports as a latency vs offered load table
+    /// </summary>
+    static void printReports(const std::vector<LatencyReport>& reports, std::ostream& os);
+};
+
+} // namespace matchingengine
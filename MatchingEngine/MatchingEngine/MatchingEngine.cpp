@@ -1,17 +1,153 @@
 #include "MatchingEngine.h"
+#include "OrderTracer.h"
+#include "TextFormat.h"
 
 namespace matchingengine {
 
+// events are written out whenever this much is pending
+static const std::size_t k_eventsBufferSize = 16 * 1024;
 
-void MatchingEngine::insertIntoPriceMap(PriceMap& priceMap, std::shared_ptr<Order> order)
+
+std::size_t OrderIdHash::operator()(const OrderIdString& orderId) const
 {
-    if (priceMap.find(order->m_price) != priceMap.end()) {
-        // this price already exists
-        priceMap[order->m_price].push_back(order);
+    std::size_t hash = 2166136261u;
+    for (char c : orderId) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 16777619u;
     }
-    else {
+    return hash;
+}
+
+
+MatchingEngine::MatchingEngine() :
+    m_memoryPool(new MemoryPool()),
+    m_idIndexBytes(0),
+    m_levelBytes(0),
+    m_orderBytes(0),
+    m_stringBytes(0),
+    m_maxOrderIdLength(0),
+    m_orderIdToOrder(makeAllocator(m_idIndexBytes)),
+    m_priceMapBuy(makeAllocator(m_levelBytes)),
+    m_priceMapSell(makeAllocator(m_levelBytes))
+{
+    m_events.reserve(k_eventsBufferSize);
+}
+
+
+void MatchingEngine::insertIntoPriceMap(PriceMap& priceMap, std::shared_ptr<Order> order)
+{
+    auto ordersPerPrice = priceMap.find(order->m_price);
+    if (ordersPerPrice == priceMap.end()) {
         // new price
-        priceMap.emplace(order->m_price, OrdersList{ order });
+        ordersPerPrice = priceMap.emplace(order->m_price,
+            PriceLevel(makeAllocator(m_levelBytes))).first;
+    }
+
+    PriceLevel& priceLevel = ordersPerPrice->second;
+    priceLevel.m_totalQuantity += order->m_quantity;
+    if (order->m_quantity <= 0) {
+        ++priceLevel.m_numNonPositiveOrders;
+    }
+    priceLevel.m_orders.push_back(order);
+}
+
+
+OrderIdString MatchingEngine::toOrderIdString(const OrderId& orderId)
+{
+    return OrderIdString(orderId.data(), orderId.size(), makeAllocator(m_stringBytes));
+}
+
+
+PoolAllocator<char> MatchingEngine::makeAllocator(std::size_t& allocatedBytes)
+{
+    return PoolAllocator<char>(m_memoryPool.get(), &allocatedBytes);
+}
+
+
+std::size_t MatchingEngine::poolBytesFor(std::size_t maxOrders,
+    std::size_t maxLevels,
+    std::size_t maxOrderIdLength)
+{
+    // node sizes are implementation defined; four pointers of bookkeeping per node
+    // covers list, tree and hash nodes as well as the shared_ptr control block
+    const std::size_t nodeOverhead = 4 * sizeof(void*);
+    const std::size_t orderBytes = MemoryPool::blockSize(sizeof(Order) + nodeOverhead)
+        + MemoryPool::blockSize(sizeof(std::shared_ptr<Order>) + nodeOverhead)
+        + MemoryPool::blockSize(sizeof(OrderIdMap::value_type) + nodeOverhead);
+    const std::size_t levelBytes = MemoryPool::blockSize(sizeof(PriceMap::value_type) + nodeOverhead)
+        + MemoryPool::blockSize(sizeof(std::shared_ptr<Order>) + nodeOverhead);
+    // an ID is held by the order and by the index key, plus one transient lookup key
+    const std::size_t orderIdBytes = MemoryPool::blockSize(maxOrderIdLength + 1);
+
+    return maxOrders * (orderBytes + 2 * orderIdBytes)
+        + maxLevels * levelBytes
+        + orderIdBytes;
+}
+
+
+void MatchingEngine::reserve(std::size_t maxOrders,
+    std::size_t maxLevels,
+    std::size_t maxOrderIdLength)
+{
+    if (MemoryPool::blockSize(maxOrderIdLength + 1) > MemoryPool::k_maxBlockSize) {
+        throw std::runtime_error("Order ID length beyond the memory pool's largest block!");
+    }
+
+    m_maxOrderIdLength = std::max(m_maxOrderIdLength, maxOrderIdLength);
+    m_orderIdToOrder.reserve(maxOrders);
+    m_memoryPool->reserve(poolBytesFor(maxOrders, maxLevels, maxOrderIdLength));
+}
+
+
+MemoryUsage MatchingEngine::memoryUsage() const
+{
+    MemoryUsage memoryUsage;
+    memoryUsage.m_idIndexBytes = m_idIndexBytes;
+    memoryUsage.m_levelBytes = m_levelBytes;
+    memoryUsage.m_orderBytes = m_orderBytes;
+    memoryUsage.m_stringBytes = m_stringBytes;
+    memoryUsage.m_poolReservedBytes = m_memoryPool->reservedBytes();
+    memoryUsage.m_poolFreeBytes = m_memoryPool->reservedBytes() - m_memoryPool->bytesInUse();
+    memoryUsage.m_numOrders = m_orderIdToOrder.size();
+    memoryUsage.m_numLevels = m_priceMapBuy.size() + m_priceMapSell.size();
+    return memoryUsage;
+}
+
+
+void MatchingEngine::compact()
+{
+    // the old book moves out and dies at the end of this scope, containers before
+    // their pool; the counters net out as the old allocators give their bytes back
+    std::unique_ptr<MemoryPool> oldMemoryPool(std::move(m_memoryPool));
+    OrderIdMap oldOrderIdToOrder(std::move(m_orderIdToOrder));
+    PriceMap oldPriceMapBuy(std::move(m_priceMapBuy));
+    PriceMap oldPriceMapSell(std::move(m_priceMapSell));
+
+    m_memoryPool.reset(new MemoryPool());
+    m_orderIdToOrder = OrderIdMap(makeAllocator(m_idIndexBytes));
+    m_priceMapBuy = PriceMap(makeAllocator(m_levelBytes));
+    m_priceMapSell = PriceMap(makeAllocator(m_levelBytes));
+
+    m_orderIdToOrder.reserve(oldOrderIdToOrder.size());
+    m_memoryPool->reserve(poolBytesFor(oldOrderIdToOrder.size(),
+        oldPriceMapBuy.size() + oldPriceMapSell.size(),
+        m_maxOrderIdLength));
+
+    // re-insert level by level in queue order, which keeps time priority
+    for (const PriceMap* oldPriceMap : { &oldPriceMapBuy, &oldPriceMapSell }) {
+        for (const auto& ordersPerPrice : *oldPriceMap) {
+            for (const std::shared_ptr<Order>& oldOrder : ordersPerPrice.second.m_orders) {
+                OrderIdString orderId(oldOrder->m_orderId.data(),
+                    oldOrder->m_orderId.size(),
+                    makeAllocator(m_stringBytes));
+                insertOrder(std::allocate_shared<Order>(PoolAllocator<Order>(m_memoryPool.get(), &m_orderBytes),
+                    oldOrder->m_orderType,
+                    oldOrder->m_orderSide,
+                    oldOrder->m_price,
+                    oldOrder->m_quantity,
+                    orderId));
+            }
+        }
     }
 }
 
@@ -45,11 +181,7 @@ std::string Order::OrderSideToString(OrderSide orderSide)
 void MatchingEngine::printPriceQuantitySummary(const PriceMap& priceMap, std::ostream& os) const
 {
     for (const auto& priceEntry : priceMap) {
-        const auto& orders = priceEntry.second;
-        Quantity quantitySum = std::accumulate(orders.cbegin(),
-            orders.cend(),
-            0,
-            [](Quantity sum, std::shared_ptr<Order> order) { return sum + order->m_quantity; });
+        Quantity quantitySum = static_cast<Quantity>(priceEntry.second.m_totalQuantity);
         if (quantitySum > 0) {
             os << priceEntry.first << " " << quantitySum << "\n";
         }
@@ -66,7 +198,7 @@ void MatchingEngine::print() const
 }
 
 
-bool MatchingEngine::isValidOrder(Price price, Quantity quantity, const OrderId& orderId) const
+bool MatchingEngine::isValidOrder(Price price, Quantity quantity, const OrderIdString& orderId) const
 {
     if (price <= 0 || quantity <= 0) {
         return false;
@@ -82,7 +214,7 @@ bool MatchingEngine::isValidOrder(Price price, Quantity quantity, const OrderId&
 
 void MatchingEngine::insertOrder(std::shared_ptr<Order> newOrder)
 {
-    m_orderIdToOrder[newOrder->m_orderId] = newOrder;
+    m_orderIdToOrder.emplace(newOrder->m_orderId, newOrder);
     switch (newOrder->m_orderSide) {
     case OrderSide::BUY: {
         insertIntoPriceMap(m_priceMapBuy, newOrder);
@@ -94,31 +226,125 @@ void MatchingEngine::insertOrder(std::shared_ptr<Order> newOrder)
 }
 
 
-bool MatchingEngine::isPriceCross(std::shared_ptr<Order> buyOrder,
-    std::shared_ptr<Order> sellOrder) const
+bool MatchingEngine::isPriceCross(Price buyPrice, Price sellPrice) const
 {
-    if (buyOrder->m_orderSide != OrderSide::BUY || sellOrder->m_orderSide != OrderSide::SELL) {
-        throw std::runtime_error("Wrong order sides");
+    return buyPrice >= sellPrice;
+}
+
+
+void MatchingEngine::appendTradeEvent(const Order& olderOrder,
+    const Order& newOrder,
+    Quantity tradeQuantity)
+{
+    // "TRADE " plus four numbers of up to 11 chars and five separators
+    reserveEvent(6 + 4 * 11 + 5 + olderOrder.m_orderId.size() + newOrder.m_orderId.size());
+
+    m_events += "TRADE ";
+    m_events.append(olderOrder.m_orderId.data(), olderOrder.m_orderId.size());
+    m_events += ' ';
+    appendInteger(m_events, olderOrder.m_price);
+    m_events += ' ';
+    appendInteger(m_events, tradeQuantity);
+    m_events += ' ';
+    m_events.append(newOrder.m_orderId.data(), newOrder.m_orderId.size());
+    m_events += ' ';
+    appendInteger(m_events, newOrder.m_price);
+    m_events += ' ';
+    appendInteger(m_events, tradeQuantity);
+    m_events += '\n';
+}
+
+
+void MatchingEngine::appendCancelEvent(const Order& order)
+{
+    // "CANCELLED " plus side, two numbers of up to 11 chars and three separators
+    reserveEvent(10 + 4 + 2 * 11 + 3 + order.m_orderId.size());
+
+    m_events += "CANCELLED ";
+    m_events.append(order.m_orderId.data(), order.m_orderId.size());
+    m_events += ' ';
+    m_events += order.m_orderSide == OrderSide::BUY ? "BUY" : "SELL";
+    m_events += ' ';
+    appendInteger(m_events, order.m_price);
+    m_events += ' ';
+    appendInteger(m_events, order.m_quantity);
+    m_events += '\n';
+}
+
+
+void MatchingEngine::reserveEvent(std::size_t length)
+{
+    if (m_events.size() + length > m_events.capacity()) {
+        flushEvents();
+    }
+}
+
+
+template <bool traced>
+void MatchingEngine::flushEvents()
+{
+    if (!m_events.empty()) {
+        TraceScope<traced> traceScope("output", "bytes", static_cast<long long>(m_events.size()));
+        std::cout.write(m_events.data(), m_events.size());
+        m_events.clear();
+    }
+}
+
+
+bool MatchingEngine::canSweepLevel(const PriceLevel& priceLevel, const Order& newOrder) const
+{
+    return priceLevel.m_numNonPositiveOrders == 0 && newOrder.m_quantity >= priceLevel.m_totalQuantity;
+}
+
+
+void MatchingEngine::sweepLevel(PriceLevel& priceLevel, Order& newOrder)
+{
+    // every queued order is filled for its full quantity, so the trade events
+    // are known up front and can be emitted in one pass
+    for (const auto& olderOrder : priceLevel.m_orders) {
+        appendTradeEvent(*olderOrder, newOrder, olderOrder->m_quantity);
+    }
+
+    // then retire the orders and empty the level in one go, the caller erases it
+    for (const auto& olderOrder : priceLevel.m_orders) {
+        m_orderIdToOrder.erase(olderOrder->m_orderId);
     }
-    return buyOrder->m_price >= sellOrder->m_price;
+    newOrder.m_quantity -= static_cast<Quantity>(priceLevel.m_totalQuantity);
+    priceLevel.m_orders.clear();
+    priceLevel.m_totalQuantity = 0;
 }
 
 
-void MatchingEngine::printTradeEvent(std::shared_ptr<Order> olderOrder,
-    std::shared_ptr<Order> newOrder,
-    Quantity tradeQuantity,
-    std::ostream& os) const
+void MatchingEngine::tradeLevel(PriceLevel& priceLevel, Order& newOrder)
 {
-    os << "TRADE " << olderOrder->m_orderId
-        << " " << olderOrder->m_price
-        << " " << tradeQuantity
-        << " " << newOrder->m_orderId
-        << " " << newOrder->m_price
-        << " " << tradeQuantity
-        << "\n";
+    for (auto olderOrder = priceLevel.m_orders.begin();
+        olderOrder != priceLevel.m_orders.end() && newOrder.m_quantity > 0;) {
+
+        // matched
+        Quantity olderQuantity = (*olderOrder)->m_quantity;
+        Quantity tradeQuantity = std::min(newOrder.m_quantity, olderQuantity);
+        appendTradeEvent(**olderOrder, newOrder, tradeQuantity);
+        // update remaining quantities
+        (*olderOrder)->m_quantity -= tradeQuantity;
+        newOrder.m_quantity -= tradeQuantity;
+        priceLevel.m_totalQuantity -= tradeQuantity;
+
+        if ((*olderOrder)->m_quantity <= 0) {
+            // remove older order
+            if (olderQuantity <= 0) {
+                --priceLevel.m_numNonPositiveOrders;
+            }
+            m_orderIdToOrder.erase((*olderOrder)->m_orderId);
+            olderOrder = priceLevel.m_orders.erase(olderOrder);
+        }
+        else {
+            ++olderOrder;
+        }
+    }
 }
 
 
+template <bool traced>
 void MatchingEngine::tradeSellOrder(std::shared_ptr<Order> newOrder)
 {
     if (newOrder->m_orderSide != OrderSide::SELL) {
@@ -126,48 +352,37 @@ void MatchingEngine::tradeSellOrder(std::shared_ptr<Order> newOrder)
     }
 
     // for Sell order, just need to compare with queued buy orders from high price to low price
-    for (auto buyOrdersPerPrice = m_priceMapBuy.begin(); buyOrdersPerPrice != m_priceMapBuy.end();) {
-        for (auto buyOrder = buyOrdersPerPrice->second.begin(); buyOrder != buyOrdersPerPrice->second.end();) {
+    for (auto buyOrdersPerPrice = m_priceMapBuy.begin();
+        buyOrdersPerPrice != m_priceMapBuy.end() && newOrder->m_quantity > 0;) {
 
-            if (newOrder->m_quantity <= 0) {
-                // trade is done
-                break;
-            }
+        if (!isPriceCross(buyOrdersPerPrice->first, newOrder->m_price)) {
+            // there no more buy order price equal or higher than newOrder (sell) price
+            break;
+        }
 
-            if (isPriceCross(*buyOrder, newOrder)) {
-                // matched
-                Quantity tradeQuantity = std::min(newOrder->m_quantity, (*buyOrder)->m_quantity);
-                printTradeEvent(*buyOrder, newOrder, tradeQuantity, std::cout);
-                // update remaining quantities 
-                (*buyOrder)->m_quantity -= tradeQuantity;
-                newOrder->m_quantity -= tradeQuantity;
-
-                if ((*buyOrder)->m_quantity <= 0) {
-                    // remove buyOrder
-                    m_orderIdToOrder.erase((*buyOrder)->m_orderId);
-                    buyOrder = buyOrdersPerPrice->second.erase(buyOrder);
-                }
-                else {
-                    ++buyOrder;
-                }
-            }
-            else {
-                // there no more buy order price equal or higher than newOrder (sell) price
-                break;
-            }
+        // one span per level touched, including erasing it
+        TraceScope<traced> traceScope("level", "price", buyOrdersPerPrice->first);
+        if (canSweepLevel(buyOrdersPerPrice->second, *newOrder)) {
+            sweepLevel(buyOrdersPerPrice->second, *newOrder);
+        }
+        else {
+            tradeLevel(buyOrdersPerPrice->second, *newOrder);
         }
 
-        if (buyOrdersPerPrice->second.empty()) {
+        if (buyOrdersPerPrice->second.m_orders.empty()) {
             // all queued buy orders at this price are traded
-            m_priceMapBuy.erase(buyOrdersPerPrice++);
+            buyOrdersPerPrice = m_priceMapBuy.erase(buyOrdersPerPrice);
         }
         else {
             ++buyOrdersPerPrice;
         }
     }
+
+    flushEvents<traced>();
 }
 
 
+template <bool traced>
 void MatchingEngine::tradeBuyOrder(std::shared_ptr<Order> newOrder)
 {
     if (newOrder->m_orderSide != OrderSide::BUY) {
@@ -176,41 +391,27 @@ void MatchingEngine::tradeBuyOrder(std::shared_ptr<Order> newOrder)
 
     // for Buy orders, need to compare with queued sell orders from the first price that's equal or smaller than sell price
     for (auto sellOrdersPerPrice = m_priceMapSell.lower_bound(newOrder->m_price);
-        sellOrdersPerPrice != m_priceMapSell.end();) {
-        for (auto sellOrder = sellOrdersPerPrice->second.begin(); sellOrder != sellOrdersPerPrice->second.end();) {
+        sellOrdersPerPrice != m_priceMapSell.end() && newOrder->m_quantity > 0;) {
 
-            if (newOrder->m_quantity <= 0) {
-                // trade is done
-                break;
-            }
-
-            if (isPriceCross(newOrder, *sellOrder)) {
-                // matched
-                Quantity tradeQuantity = std::min(newOrder->m_quantity, (*sellOrder)->m_quantity);
-                printTradeEvent(*sellOrder, newOrder, tradeQuantity, std::cout);
-                // update remaining quantities
-                (*sellOrder)->m_quantity -= tradeQuantity;
-                newOrder->m_quantity -= tradeQuantity;
-
-                if ((*sellOrder)->m_quantity <= 0) {
-                    // remove sell order
-                    m_orderIdToOrder.erase((*sellOrder)->m_orderId);
-                    sellOrder = sellOrdersPerPrice->second.erase(sellOrder);
-                }
-                else {
-                    ++sellOrder;
-                }
-            }
+        // one span per level touched, including erasing it
+        TraceScope<traced> traceScope("level", "price", sellOrdersPerPrice->first);
+        if (canSweepLevel(sellOrdersPerPrice->second, *newOrder)) {
+            sweepLevel(sellOrdersPerPrice->second, *newOrder);
+        }
+        else {
+            tradeLevel(sellOrdersPerPrice->second, *newOrder);
         }
 
-        if (sellOrdersPerPrice->second.empty()) {
+        if (sellOrdersPerPrice->second.m_orders.empty()) {
             // all queued sell orders at this price are traded
-            m_priceMapSell.erase(sellOrdersPerPrice++);
+            sellOrdersPerPrice = m_priceMapSell.erase(sellOrdersPerPrice);
         }
         else {
             ++sellOrdersPerPrice;
         }
     }
+
+    flushEvents<traced>();
 }
 
 
@@ -219,32 +420,63 @@ void MatchingEngine::processOrder(OrderType orderType,
     Price price,
     Quantity quantity,
     const OrderId& orderId)
+{
+    processOrderImpl<false>(orderType, orderSide, price, quantity, orderId);
+}
+
+
+void MatchingEngine::processOrderTraced(OrderType orderType,
+    OrderSide orderSide,
+    Price price,
+    Quantity quantity,
+    const OrderId& orderId)
+{
+    processOrderImpl<true>(orderType, orderSide, price, quantity, orderId);
+}
+
+
+template <bool traced>
+void MatchingEngine::processOrderImpl(OrderType orderType,
+    OrderSide orderSide,
+    Price price,
+    Quantity quantity,
+    const OrderId& orderId)
 {   
+    OrderIdString newOrderId = toOrderIdString(orderId);
+
     // validate order
-    if (!isValidOrder(price, quantity, orderId)) {
-        return;
+    {
+        TraceScope<traced> traceScope("validate");
+        if (!isValidOrder(price, quantity, newOrderId)) {
+            return;
+        }
     }
 
     // create a new order
-    std::shared_ptr<Order> newOrder = std::make_shared<Order>(orderType,
+    std::shared_ptr<Order> newOrder = std::allocate_shared<Order>(PoolAllocator<Order>(m_memoryPool.get(), &m_orderBytes),
+        orderType,
         orderSide,
         price,
         quantity,
-        orderId);
-
-    switch (orderSide) {
-    case OrderSide::SELL:
-        tradeSellOrder(newOrder);
-        break;
-    case OrderSide::BUY:
-        tradeBuyOrder(newOrder);
-        break;
-    default:
-        throw std::runtime_error("Unsupported order side!");
+        newOrderId);
+
+    {
+        TraceScope<traced> traceScope("match");
+        switch (orderSide) {
+        case OrderSide::SELL:
+            tradeSellOrder<traced>(newOrder);
+            break;
+        case OrderSide::BUY:
+            tradeBuyOrder<traced>(newOrder);
+            break;
+        default:
+            throw std::runtime_error("Unsupported order side!");
+        }
     }
 
     if (newOrder->m_quantity > 0 && newOrder->m_orderType == OrderType::GFD) {
         // new order has non-traded quantity and is of type GFD, need to queue it
+        TraceScope<traced> traceScope("rest");
         insertOrder(newOrder);
     }
 }
@@ -260,21 +492,26 @@ void MatchingEngine::purgeEngine()
 
 void MatchingEngine::eraseOrderFromPriceMap(PriceMap& priceMap,
     Price price,
-    const OrderId& orderId)
+    const OrderIdString& orderId)
 {
     auto ordersPerPrice = priceMap.find(price);
     if (ordersPerPrice != priceMap.end()) {
-        auto orderItr = std::find_if(ordersPerPrice->second.begin(),
-            ordersPerPrice->second.end(),
-            [orderId](std::shared_ptr<Order> order) {
+        PriceLevel& priceLevel = ordersPerPrice->second;
+        auto orderItr = std::find_if(priceLevel.m_orders.begin(),
+            priceLevel.m_orders.end(),
+            [&orderId](std::shared_ptr<Order> order) {
                 return order->m_orderId == orderId;
             });
-        if (orderItr != ordersPerPrice->second.end()) {
-            ordersPerPrice->second.erase(orderItr);
+        if (orderItr != priceLevel.m_orders.end()) {
+            priceLevel.m_totalQuantity -= (*orderItr)->m_quantity;
+            if ((*orderItr)->m_quantity <= 0) {
+                --priceLevel.m_numNonPositiveOrders;
+            }
+            priceLevel.m_orders.erase(orderItr);
         }
 
-        if (ordersPerPrice->second.empty()) {
-            priceMap.erase(price);
+        if (priceLevel.m_orders.empty()) {
+            priceMap.erase(ordersPerPrice);
         }
     }
 }
@@ -282,25 +519,26 @@ void MatchingEngine::eraseOrderFromPriceMap(PriceMap& priceMap,
 
 void MatchingEngine::cancelOrder(const OrderId& orderId)
 {
-    if (m_orderIdToOrder.find(orderId) == m_orderIdToOrder.cend()) {
+    auto orderEntry = m_orderIdToOrder.find(toOrderIdString(orderId));
+    if (orderEntry == m_orderIdToOrder.end()) {
         // order Id doesn't exist, no op
         return;
     }
 
-    Price price = m_orderIdToOrder[orderId]->m_price;
-    OrderSide orderSide = m_orderIdToOrder[orderId]->m_orderSide;
+    Price price = orderEntry->second->m_price;
+    OrderSide orderSide = orderEntry->second->m_orderSide;
     switch (orderSide) {
     case OrderSide::BUY:
-        eraseOrderFromPriceMap(m_priceMapBuy, price, orderId);
+        eraseOrderFromPriceMap(m_priceMapBuy, price, orderEntry->first);
         break;
     case OrderSide::SELL:
-        eraseOrderFromPriceMap(m_priceMapSell, price, orderId);
+        eraseOrderFromPriceMap(m_priceMapSell, price, orderEntry->first);
         break;
     default:
         throw std::runtime_error("Unsupported order side!");
     }
 
-    m_orderIdToOrder.erase(orderId);
+    m_orderIdToOrder.erase(orderEntry);
 }
 
 
@@ -309,12 +547,14 @@ void MatchingEngine::modifyOrder(const OrderId& orderId,
     Price newPrice,
     Quantity newQuantity)
 {
-    if (m_orderIdToOrder.find(orderId) == m_orderIdToOrder.cend()) {
+    auto orderEntry = m_orderIdToOrder.find(toOrderIdString(orderId));
+    if (orderEntry == m_orderIdToOrder.end()) {
         // order doesn't exist, no op
         return;
     }
 
-    auto& order = m_orderIdToOrder[orderId];
+    const OrderIdString& modifiedOrderId = orderEntry->first;
+    auto& order = orderEntry->second;
 
     if (order->m_orderType == OrderType::IOC) {
         // cannot modify IOC order, no op
@@ -323,23 +563,24 @@ void MatchingEngine::modifyOrder(const OrderId& orderId,
 
     OrderSide oldOrderSide = order->m_orderSide;
     Price oldPrice = order->m_price;
-    
-
-    order->m_price = newPrice;
-    order->m_quantity = newQuantity;
-    order->m_orderSide = newOrderSide;
 
+    // take the order out of its level before changing it, the level's cached
+    // quantity still has to account for the old quantity
     switch(oldOrderSide) {
     case OrderSide::BUY:
-        eraseOrderFromPriceMap(m_priceMapBuy, oldPrice, orderId);
+        eraseOrderFromPriceMap(m_priceMapBuy, oldPrice, modifiedOrderId);
         break;
     case OrderSide::SELL:
-        eraseOrderFromPriceMap(m_priceMapSell, oldPrice, orderId);
+        eraseOrderFromPriceMap(m_priceMapSell, oldPrice, modifiedOrderId);
         break;
     default:
         throw std::runtime_error("Unsupported order side!");
     }
 
+    order->m_price = newPrice;
+    order->m_quantity = newQuantity;
+    order->m_orderSide = newOrderSide;
+
     switch (newOrderSide) {
     case OrderSide::BUY:
         insertIntoPriceMap(m_priceMapBuy, order);
@@ -354,7 +595,120 @@ void MatchingEngine::modifyOrder(const OrderId& orderId,
 }
 
 
+void MatchingEngine::cancelLevels(PriceMap& priceMap,
+    PriceMap::iterator first,
+    PriceMap::iterator last,
+    bool reportOrders,
+    MassCancelSummary& summary)
+{
+    for (auto ordersPerPrice = first; ordersPerPrice != last; ++ordersPerPrice) {
+        for (const auto& order : ordersPerPrice->second.m_orders) {
+            if (reportOrders) {
+                appendCancelEvent(*order);
+            }
+            m_orderIdToOrder.erase(order->m_orderId);
+        }
+        summary.m_numOrders += ordersPerPrice->second.m_orders.size();
+        summary.m_totalQuantity += ordersPerPrice->second.m_totalQuantity;
+    }
+
+    // whole levels go in one operation
+    priceMap.erase(first, last);
+}
+
+
+void MatchingEngine::cancelOrdersByIdPrefix(PriceMap& priceMap,
+    const OrderId& orderIdPrefix,
+    bool reportOrders,
+    MassCancelSummary& summary)
+{
+    for (auto ordersPerPrice = priceMap.begin(); ordersPerPrice != priceMap.end();) {
+        PriceLevel& priceLevel = ordersPerPrice->second;
+        for (auto order = priceLevel.m_orders.begin(); order != priceLevel.m_orders.end();) {
+            if ((*order)->m_orderId.compare(0, orderIdPrefix.size(), orderIdPrefix.data(), orderIdPrefix.size()) != 0) {
+                ++order;
+                continue;
+            }
+
+            if (reportOrders) {
+                appendCancelEvent(**order);
+            }
+            ++summary.m_numOrders;
+            summary.m_totalQuantity += (*order)->m_quantity;
+            priceLevel.m_totalQuantity -= (*order)->m_quantity;
+            if ((*order)->m_quantity <= 0) {
+                --priceLevel.m_numNonPositiveOrders;
+            }
+            m_orderIdToOrder.erase((*order)->m_orderId);
+            order = priceLevel.m_orders.erase(order);
+        }
+
+        if (priceLevel.m_orders.empty()) {
+            ordersPerPrice = priceMap.erase(ordersPerPrice);
+        }
+        else {
+            ++ordersPerPrice;
+        }
+    }
+}
+
+
+void MatchingEngine::reportMassCancel(const MassCancelSummary& summary)
+{
+    // "MASSCANCELLED " plus two numbers of up to 20 chars and a separator
+    reserveEvent(14 + 2 * 20 + 2);
+
+    m_events += "MASSCANCELLED ";
+    appendInteger(m_events, static_cast<long long>(summary.m_numOrders));
+    m_events += ' ';
+    appendInteger(m_events, summary.m_totalQuantity);
+    m_events += '\n';
+    flushEvents();
+}
 
 
+void MatchingEngine::cancelOrdersBySide(OrderSide orderSide, bool reportOrders)
+{
+    MassCancelSummary summary = { 0, 0 };
+    switch (orderSide) {
+    case OrderSide::BUY:
+        cancelLevels(m_priceMapBuy, m_priceMapBuy.begin(), m_priceMapBuy.end(), reportOrders, summary);
+        break;
+    case OrderSide::SELL:
+        cancelLevels(m_priceMapSell, m_priceMapSell.begin(), m_priceMapSell.end(), reportOrders, summary);
+        break;
+    default:
+        throw std::runtime_error("Unsupported order side!");
+    }
+    reportMassCancel(summary);
+}
+
+
+void MatchingEngine::cancelOrdersByPriceRange(OrderSide orderSide,
+    Price minPrice,
+    Price maxPrice,
+    bool reportOrders)
+{
+    MassCancelSummary summary = { 0, 0 };
+    if (minPrice <= maxPrice) {
+        PriceMap& priceMap = orderSide == OrderSide::BUY ? m_priceMapBuy : m_priceMapSell;
+        // price maps run from high to low price
+        cancelLevels(priceMap,
+            priceMap.lower_bound(maxPrice),
+            priceMap.upper_bound(minPrice),
+            reportOrders,
+            summary);
+    }
+    reportMassCancel(summary);
+}
+
+
+void MatchingEngine::cancelOrdersByIdPrefix(const OrderId& orderIdPrefix, bool reportOrders)
+{
+    MassCancelSummary summary = { 0, 0 };
+    cancelOrdersByIdPrefix(m_priceMapBuy, orderIdPrefix, reportOrders, summary);
+    cancelOrdersByIdPrefix(m_priceMapSell, orderIdPrefix, reportOrders, summary);
+    reportMassCancel(summary);
+}
 
 } // namespace matchingengine
\ No newline at end of file
@@ -8,26 +8,38 @@
 
 #include <memory>
 #include <algorithm>
-#include <numeric>
 #include <stdexcept>
 
 #include "MatchingEngineI.h"
+#include "MemoryPool.h"
 
 namespace matchingengine {
 
+/// <summary>
+/// order ID as stored inside the engine, its characters live in the engine's memory pool
+/// </summary>
+using OrderIdString = std::basic_string<char, std::char_traits<char>, PoolAllocator<char> >;
+
+/// <summary>
+/// FNV-1a hash of an OrderIdString
+/// </summary>
+struct OrderIdHash {
+    std::size_t operator()(const OrderIdString& orderId) const;
+};
+
 class Order {
 public:
-    OrderType m_orderType;
-    OrderSide m_orderSide;
-    Price     m_price;
-    Quantity  m_quantity;
-    OrderId   m_orderId;
+    OrderType     m_orderType;
+    OrderSide     m_orderSide;
+    Price         m_price;
+    Quantity      m_quantity;
+    OrderIdString m_orderId;
 
     Order(OrderType orderType,
         OrderSide orderSide,
         Price price,
         Quantity quantity,
-        const OrderId& orderId) :
+        const OrderIdString& orderId) :
         m_orderType(orderType),
         m_orderSide(orderSide),
         m_price(price),
@@ -52,6 +64,18 @@ class MatchingEngine : public MatchingEngineI {
 
 public:
 
+    /// <summary>
+    /// ctor, all containers allocate from the engine's memory pool
+    /// </summary>
+    MatchingEngine();
+
+    // the containers' allocators count into this engine's m_*Bytes members, a copy
+    // or a move would leave them counting into the original
+    MatchingEngine(const MatchingEngine&) = delete;
+    MatchingEngine& operator=(const MatchingEngine&) = delete;
+    MatchingEngine(MatchingEngine&&) = delete;
+    MatchingEngine& operator=(MatchingEngine&&) = delete;
+
     /// <summary>
     /// execute message PRINT
     /// </summary>
@@ -67,6 +91,16 @@ public:
         Quantity quantity,
         const OrderId& orderId);
 
+    /// <summary>
+    /// processOrder() of a message sampled by OrderTracer, timing validate, match,
+    /// each level touched, output and rest as spans
+    /// </summary>
+    void processOrderTraced(OrderType orderType,
+        OrderSide orderSide,
+        Price price,
+        Quantity quantity,
+        const OrderId& orderId);
+
     /// <summary>
     /// purge mathing engine, delete all queued orders
     /// </summary>
@@ -85,16 +119,103 @@ public:
         Price newPrice,
         Quantity newQuantity);
 
+    /// <summary>
+    /// cancel all orders on one side; emits one summary event, and one event per
+    /// cancelled order if reportOrders
+    /// </summary>
+    void cancelOrdersBySide(OrderSide orderSide, bool reportOrders);
+
+    /// <summary>
+    /// cancel all orders on one side priced within [minPrice, maxPrice], dropping
+    /// whole levels at once; emits events like cancelOrdersBySide
+    /// </summary>
+    void cancelOrdersByPriceRange(OrderSide orderSide,
+        Price minPrice,
+        Price maxPrice,
+        bool reportOrders);
+
+    /// <summary>
+    /// cancel all orders, on both sides, whose ID starts with orderIdPrefix, e.g. an
+    /// owner tag; one pass over the book; emits events like cancelOrdersBySide
+    /// </summary>
+    void cancelOrdersByIdPrefix(const OrderId& orderIdPrefix, bool reportOrders);
+
+    /// <summary>
+    /// pre-size the ID index and the memory pool for up to maxOrders resting orders
+    /// spread over up to maxLevels price levels, with IDs up to maxOrderIdLength chars;
+    /// a workload within these limits then runs without heap allocations. IDs must fit
+    /// a MemoryPool block, longer ones would come from the heap: throws
+    /// std::runtime_error if maxOrderIdLength is k_maxBlockSize or more
+    /// </summary>
+    void reserve(std::size_t maxOrders,
+        std::size_t maxLevels,
+        std::size_t maxOrderIdLength);
+
+    /// <summary>
+    /// returns the bytes held by the ID index, the price levels, the orders and the
+    /// order ID characters, and how much of the memory pool is reserved and unused
+    /// </summary>
+    MemoryUsage memoryUsage() const;
+
+    /// <summary>
+    /// rebuild the book into a fresh memory pool sized for the orders resting now,
+    /// rehashing the ID index and giving every slab of the old pool back to the heap;
+    /// queue priority is preserved; earlier reservations are dropped, call reserve()
+    /// again if needed
+    /// </summary>
+    void compact();
+
 
 private:
-    using OrdersList = std::list<std::shared_ptr<Order> >;
-    using PriceMap = std::map<Price, OrdersList, std::greater<Price> >;
+    using OrdersList = std::list<std::shared_ptr<Order>, PoolAllocator<std::shared_ptr<Order> > >;
+
+    /// <summary>
+    /// orders queued at one price, with their total quantity cached so that an
+    /// aggressive order can tell up front whether it consumes the whole level
+    /// </summary>
+    struct PriceLevel {
+        OrdersList  m_orders;
+        long long   m_totalQuantity;
+        // orders modified to a non-positive quantity, a level with any can't be swept
+        std::size_t m_numNonPositiveOrders;
+
+        explicit PriceLevel(const PoolAllocator<char>& allocator) :
+            m_orders(allocator),
+            m_totalQuantity(0),
+            m_numNonPositiveOrders(0) {}
+    };
+
+    using PriceMap = std::map<Price,
+        PriceLevel,
+        std::greater<Price>,
+        PoolAllocator<std::pair<const Price, PriceLevel> > >;
+    using OrderIdMap = std::unordered_map<OrderIdString,
+        std::shared_ptr<Order>,
+        OrderIdHash,
+        std::equal_to<OrderIdString>,
+        PoolAllocator<std::pair<const OrderIdString, std::shared_ptr<Order> > > >;
+
+    // must be declared first, containers below give their memory back on destruction;
+    // held by pointer so that compact() can swap in a fresh one
+    std::unique_ptr<MemoryPool> m_memoryPool;
+
+    // bytes allocated by each structure, kept up to date by its allocators
+    std::size_t m_idIndexBytes;
+    std::size_t m_levelBytes;
+    std::size_t m_orderBytes;
+    std::size_t m_stringBytes;
 
-    std::unordered_map<OrderId, std::shared_ptr<Order> > m_orderIdToOrder;
+    // longest order ID reserve() was asked for, compact() sizes the new pool with it
+    std::size_t m_maxOrderIdLength;
+
+    OrderIdMap m_orderIdToOrder;
 
     PriceMap m_priceMapBuy;
     PriceMap m_priceMapSell;
 
+    // events of the current command, written out in batches
+    std::string m_events;
+
     /// <summary>
     /// Insert order into a price map, no validation
     /// </summary>
@@ -105,27 +226,74 @@ private:
     /// </summary>
     void printPriceQuantitySummary(const PriceMap& priceMap, std::ostream& os) const;
 
+    /// <summary>
+    /// processOrder() and processOrderTraced(), the spans are only compiled in if traced
+    /// </summary>
+    template <bool traced>
+    void processOrderImpl(OrderType orderType,
+        OrderSide orderSide,
+        Price price,
+        Quantity quantity,
+        const OrderId& orderId);
+
     /// <summary>
     /// trade new order (sell) against all queued buy orders in m_priceMapBuy, this function
     /// updated new order and m_priceMapBuy, but doesn't insert new order into matching engine
     /// </summary>
+    template <bool traced>
     void tradeSellOrder(std::shared_ptr<Order> newOrder);
 
     /// <summary>
     /// trade new order (buy) against all queued sell orders in m_priceMapSell, this function
     /// updated new order and m_priceMapSell, but doesn't insert new order into matching engine
     /// </summary>
+    template <bool traced>
     void tradeBuyOrder(std::shared_ptr<Order> newOrder);
 
+    /// <summary>
+    /// function returns true if new order consumes every order of a crossing level,
+    /// so the level can be swept in bulk
+    /// </summary>
+    bool canSweepLevel(const PriceLevel& priceLevel, const Order& newOrder) const;
+
+    /// <summary>
+    /// fill every order of a level against new order: emit all trade events, drop the
+    /// orders from m_orderIdToOrder, empty the level and update new order
+    /// </summary>
+    void sweepLevel(PriceLevel& priceLevel, Order& newOrder);
+
+    /// <summary>
+    /// fill orders of a crossing level one by one in time priority until
+    /// new order is done, removing the ones that are fully traded
+    /// </summary>
+    void tradeLevel(PriceLevel& priceLevel, Order& newOrder);
+
     /// <summary>
     /// erase an order from a price map
     /// </summary>
-    void eraseOrderFromPriceMap(PriceMap& priceMap, Price price, const OrderId& orderId);
+    void eraseOrderFromPriceMap(PriceMap& priceMap, Price price, const OrderIdString& orderId);
 
     /// <summary>
     /// function returns true if price, quantity, and orderId are valid, o.w. false
     /// </summary>
-    bool isValidOrder(Price price, Quantity quantity, const OrderId& orderId) const;
+    bool isValidOrder(Price price, Quantity quantity, const OrderIdString& orderId) const;
+
+    /// <summary>
+    /// copy an order ID into the engine's memory pool, for lookups and storage
+    /// </summary>
+    OrderIdString toOrderIdString(const OrderId& orderId);
+
+    /// <summary>
+    /// returns an allocator on the current memory pool that accounts into allocatedBytes
+    /// </summary>
+    PoolAllocator<char> makeAllocator(std::size_t& allocatedBytes);
+
+    /// <summary>
+    /// returns the bytes reserve() asks the memory pool for, see reserve()
+    /// </summary>
+    static std::size_t poolBytesFor(std::size_t maxOrders,
+        std::size_t maxLevels,
+        std::size_t maxOrderIdLength);
 
     /// <summary>
     /// insert order, this function doesn't validate order
@@ -133,19 +301,63 @@ private:
     void insertOrder(std::shared_ptr<Order> newOrder);
 
     /// <summary>
-    /// function returns true if buy and sell orders are price cross, meaning
+    /// function returns true if buy and sell prices are price cross, meaning
     /// buy price is equal or higher than sell price
     /// </summary>
-    bool isPriceCross(std::shared_ptr<Order> buyOrder,
-        std::shared_ptr<Order> sellOrder) const;
+    bool isPriceCross(Price buyPrice, Price sellPrice) const;
+
+    /// <summary>
+    /// append trade event to m_events
+    /// </summary>
+    void appendTradeEvent(const Order& olderOrder,
+        const Order& newOrder,
+        Quantity tradeQuantity);
+
+    /// <summary>
+    /// append cancel event of an order removed by a mass cancel to m_events
+    /// </summary>
+    void appendCancelEvent(const Order& order);
+
+    /// <summary>
+    /// make room in m_events for an event of up to length chars, flushing it if full
+    /// </summary>
+    void reserveEvent(std::size_t length);
+
+    /// <summary>
+    /// write pending events to std::cout
+    /// </summary>
+    template <bool traced = false>
+    void flushEvents();
+
+    /// <summary>
+    /// orders removed by one mass cancel
+    /// </summary>
+    struct MassCancelSummary {
+        std::size_t m_numOrders;
+        long long   m_totalQuantity;
+    };
+
+    /// <summary>
+    /// cancel every order of the levels [first, last) of a price map and erase the levels
+    /// </summary>
+    void cancelLevels(PriceMap& priceMap,
+        PriceMap::iterator first,
+        PriceMap::iterator last,
+        bool reportOrders,
+        MassCancelSummary& summary);
+
+    /// <summary>
+    /// cancel the orders of a price map whose ID starts with orderIdPrefix
+    /// </summary>
+    void cancelOrdersByIdPrefix(PriceMap& priceMap,
+        const OrderId& orderIdPrefix,
+        bool reportOrders,
+        MassCancelSummary& summary);
 
     /// <summary>
-    /// print trade event to ostream
+    /// emit the summary event of a mass cancel and flush all of its events
     /// </summary>
-    void printTradeEvent(std::shared_ptr<Order> olderOrder,
-        std::shared_ptr<Order> newOrder,
-        Quantity tradeQuantity,
-        std::ostream& os) const;
+    void reportMassCancel(const MassCancelSummary& summary);
 };
 
 } // namespace matchingengine
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
 
 namespace matchingengine {
@@ -12,6 +13,20 @@ using Price = int;
 using Quantity = int;
 using OrderId = std::string;
 
+/// <summary>
+/// bytes held by the structures of a matching engine
+/// </summary>
+struct MemoryUsage {
+    std::size_t m_idIndexBytes;       // order ID to order index, buckets and nodes
+    std::size_t m_levelBytes;         // price levels and their order queues
+    std::size_t m_orderBytes;         // orders
+    std::size_t m_stringBytes;        // order ID characters not stored inline
+    std::size_t m_poolReservedBytes;  // memory pool slabs, used or not
+    std::size_t m_poolFreeBytes;      // slab bytes not handed out, released by compact
+    std::size_t m_numOrders;          // resting orders
+    std::size_t m_numLevels;          // price levels, both sides
+};
+
 
 /// <summary>
 /// Interface class of class MatchingEngine,
@@ -31,6 +46,19 @@ public:
         Quantity quantity,
         const OrderId& orderId) = 0;
 
+    /// <summary>
+    /// processOrder() of a message sampled by OrderTracer; engines that time
+    /// their own steps as spans override it, the others just process the order
+    /// </summary>
+    virtual void processOrderTraced(OrderType orderType,
+        OrderSide orderSide,
+        Price price,
+        Quantity quantity,
+        const OrderId& orderId)
+    {
+        processOrder(orderType, orderSide, price, quantity, orderId);
+    }
+
     virtual void purgeEngine() = 0;
 
     virtual void cancelOrder(const OrderId& orderId) = 0;
@@ -39,6 +67,23 @@ public:
         OrderSide newOrderSide,
         Price newPrice,
         Quantity newQuantity) = 0;
+
+    virtual void cancelOrdersBySide(OrderSide orderSide, bool reportOrders) = 0;
+
+    virtual void cancelOrdersByPriceRange(OrderSide orderSide,
+        Price minPrice,
+        Price maxPrice,
+        bool reportOrders) = 0;
+
+    virtual void cancelOrdersByIdPrefix(const OrderId& orderIdPrefix, bool reportOrders) = 0;
+
+    virtual void reserve(std::size_t maxOrders,
+        std::size_t maxLevels,
+        std::size_t maxOrderIdLength) = 0;
+
+    virtual MemoryUsage memoryUsage() const = 0;
+
+    virtual void compact() = 0;
 };
 
 } // namespace matchingengine
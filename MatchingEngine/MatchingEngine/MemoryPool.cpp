@@ -0,0 +1,86 @@
+#include "MemoryPool.h"
+
+namespace matchingengine {
+
+
+MemoryPool::~MemoryPool()
+{
+    for (char* slab : m_slabs) {
+        ::operator delete(slab);
+    }
+}
+
+
+std::size_t MemoryPool::blockSize(std::size_t bytes)
+{
+    if (bytes == 0) {
+        bytes = 1;
+    }
+    return (bytes + k_granularity - 1) / k_granularity * k_granularity;
+}
+
+
+void MemoryPool::addSlab(std::size_t bytes)
+{
+    // the remainder of the current slab is abandoned until the pool dies
+    char* slab = static_cast<char*>(::operator new(bytes));
+    m_slabs.push_back(slab);
+    m_reservedBytes += bytes;
+    m_slabCursor = slab;
+    m_slabEnd = slab + bytes;
+}
+
+
+void MemoryPool::reserve(std::size_t bytes)
+{
+    if (static_cast<std::size_t>(m_slabEnd - m_slabCursor) < bytes) {
+        addSlab(blockSize(bytes));
+    }
+}
+
+
+void* MemoryPool::allocate(std::size_t bytes)
+{
+    std::size_t size = blockSize(bytes);
+    if (size > k_maxBlockSize) {
+        return ::operator new(bytes);
+    }
+
+    m_bytesInUse += size;
+    FreeBlock*& freeList = m_freeLists[size / k_granularity - 1];
+    if (freeList != nullptr) {
+        // recycle a block of the same size class
+        FreeBlock* block = freeList;
+        freeList = block->m_next;
+        return block;
+    }
+
+    if (static_cast<std::size_t>(m_slabEnd - m_slabCursor) < size) {
+        addSlab(k_defaultSlabSize);
+    }
+    void* block = m_slabCursor;
+    m_slabCursor += size;
+    return block;
+}
+
+
+void MemoryPool::deallocate(void* block, std::size_t bytes)
+{
+    if (block == nullptr) {
+        return;
+    }
+
+    std::size_t size = blockSize(bytes);
+    if (size > k_maxBlockSize) {
+        ::operator delete(block);
+        return;
+    }
+
+    m_bytesInUse -= size;
+    FreeBlock*& freeList = m_freeLists[size / k_granularity - 1];
+    FreeBlock* freeBlock = static_cast<FreeBlock*>(block);
+    freeBlock->m_next = freeList;
+    freeList = freeBlock;
+}
+
+} // namespace matchingengine
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace matchingengine {
+
+/// <summary>
+/// Size-class free-list pool; small blocks are carved from slabs and recycled
+/// through per-size free lists, so once reserve() has pre-sized the slabs a
+/// steady workload never goes back to the heap
+/// </summary>
+class MemoryPool
+{
+public:
+    /// <summary>
+    /// every block handed out is a multiple of this many bytes
+    /// </summary>
+    static const std::size_t k_granularity = 16;
+
+    /// <summary>
+    /// largest block served from the pool, bigger requests go to the heap
+    /// </summary>
+    static const std::size_t k_maxBlockSize = 256;
+
+    MemoryPool() {}
+
+    ~MemoryPool();
+
+    MemoryPool(const MemoryPool&) = delete;
+    MemoryPool& operator=(const MemoryPool&) = delete;
+
+    /// <summary>
+    /// allocate bytes, from a free list or the current slab if possible
+    /// </summary>
+    void* allocate(std::size_t bytes);
+
+    /// <summary>
+    /// return a block obtained from allocate() with the same byte count
+    /// </summary>
+    void deallocate(void* block, std::size_t bytes);
+
+    /// <summary>
+    /// make sure at least bytes of uncarved slab space are available,
+    /// so that the next bytes worth of new blocks don't hit the heap
+    /// </summary>
+    void reserve(std::size_t bytes);
+
+    /// <summary>
+    /// returns the size of the block that serves a request of bytes
+    /// </summary>
+    static std::size_t blockSize(std::size_t bytes);
+
+    /// <summary>
+    /// returns the bytes of all slabs, in use or not
+    /// </summary>
+    std::size_t reservedBytes() const { return m_reservedBytes; }
+
+    /// <summary>
+    /// returns the bytes of slab blocks currently handed out
+    /// </summary>
+    std::size_t bytesInUse() const { return m_bytesInUse; }
+
+private:
+    static const std::size_t k_numSizeClasses = k_maxBlockSize / k_granularity;
+    static const std::size_t k_defaultSlabSize = 64 * 1024;
+
+    struct FreeBlock {
+        FreeBlock* m_next;
+    };
+
+    FreeBlock* m_freeLists[k_numSizeClasses] = {};
+
+    std::vector<char*> m_slabs;
+    char* m_slabCursor = nullptr;
+    char* m_slabEnd = nullptr;
+
+    std::size_t m_reservedBytes = 0;
+    std::size_t m_bytesInUse = 0;
+
+    /// <summary>
+    /// allocate a new slab and make it the current one
+    /// </summary>
+    void addSlab(std::size_t bytes);
+};
+
+
+/// <summary>
+/// Standard allocator on top of MemoryPool, so the engine's containers can share
+/// one pool; a default constructed allocator has no pool and uses the heap.
+/// If given a counter, it keeps the bytes allocated through it, and through its
+/// rebound copies, up to date there, for per-structure memory accounting
+/// </summary>
+template <typename T>
+class PoolAllocator
+{
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    PoolAllocator() noexcept : m_memoryPool(nullptr), m_allocatedBytes(nullptr) {}
+
+    explicit PoolAllocator(MemoryPool* memoryPool, std::size_t* allocatedBytes = nullptr) noexcept :
+        m_memoryPool(memoryPool),
+        m_allocatedBytes(allocatedBytes) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) noexcept :
+        m_memoryPool(other.memoryPool()),
+        m_allocatedBytes(other.allocatedBytes()) {}
+
+    T* allocate(std::size_t n)
+    {
+        if (m_allocatedBytes != nullptr) {
+            *m_allocatedBytes += n * sizeof(T);
+        }
+        if (m_memoryPool == nullptr) {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T*>(m_memoryPool->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        if (m_allocatedBytes != nullptr) {
+            *m_allocatedBytes -= n * sizeof(T);
+        }
+        if (m_memoryPool == nullptr) {
+            ::operator delete(p);
+            return;
+        }
+        m_memoryPool->deallocate(p, n * sizeof(T));
+    }
+
+    MemoryPool* memoryPool() const noexcept { return m_memoryPool; }
+
+    std::size_t* allocatedBytes() const noexcept { return m_allocatedBytes; }
+
+private:
+    MemoryPool*  m_memoryPool;
+    std::size_t* m_allocatedBytes;
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>& lhs, const PoolAllocator<U>& rhs) noexcept
+{
+    return lhs.memoryPool() == rhs.memoryPool() && lhs.allocatedBytes() == rhs.allocatedBytes();
+}
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>& lhs, const PoolAllocator<U>& rhs) noexcept
+{
+    return !(lhs == rhs);
+}
+
+} // namespace matchingengine
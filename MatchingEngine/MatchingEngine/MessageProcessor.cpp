@@ -1,8 +1,16 @@
 #include "MessageProcessor.h"
+#include "StructuralScanner.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
 
 
 namespace matchingengine {
 
+const std::size_t MessageProcessor::k_maxTokens;
+
 
 template<typename T>
 std::string stringifyVector(const std::vector<T>& vec) {
@@ -15,6 +23,119 @@ std::string stringifyVector(const std::vector<T>& vec) {
     return ss.str();
 }
 
+/// <summary>
+/// std::stoi without exceptions or allocations: skips leading white space, takes an
+/// optional sign and as many digits as follow; fails if there are no digits or the
+/// value doesn't fit in an int
+/// </summary>
+static bool parseInteger(const Token& token, int& value)
+{
+    const char* p = token.m_begin;
+    const char* end = token.m_begin + token.m_length;
+
+    while (p != end && (*p == ' ' || (*p >= '\t' && *p <= '\r'))) {
+        ++p;
+    }
+
+    bool negative = false;
+    if (p != end && (*p == '+' || *p == '-')) {
+        negative = *p == '-';
+        ++p;
+    }
+
+    if (p == end || *p < '0' || *p > '9') {
+        return false;
+    }
+
+    const long long limit = negative ? -static_cast<long long>(INT_MIN) : INT_MAX;
+
+    // usual case, up to 8 digits converted in one go, they always fit in an int
+    std::uint64_t digits;
+    std::size_t numDigits;
+    if (StructuralScanner::parseDigits(p, end - p, digits, numDigits)) {
+        value = static_cast<int>(negative ? -static_cast<long long>(digits) : static_cast<long long>(digits));
+        return true;
+    }
+
+    // longer run of digits
+    long long magnitude = 0;
+    for (; p != end && *p >= '0' && *p <= '9'; ++p) {
+        magnitude = magnitude * 10 + (*p - '0');
+        if (magnitude > limit) {
+            return false;
+        }
+    }
+
+    value = static_cast<int>(negative ? -magnitude : magnitude);
+    return true;
+}
+
+
+/// <summary>
+/// a message of numTokens tokens with numRequiredTokens required ones may end in an
+/// optional DETAIL flag; function returns true if the message is well formed,
+/// o.w. false, and sets detail if the flag is there
+/// </summary>
+static bool getDetailFlag(const Token* tokens,
+    std::size_t numTokens,
+    std::size_t numRequiredTokens,
+    bool& detail)
+{
+    if (numTokens == numRequiredTokens) {
+        detail = false;
+        return true;
+    }
+    if (numTokens == numRequiredTokens + 1 && tokens[numRequiredTokens].equals("DETAIL")) {
+        detail = true;
+        return true;
+    }
+    return false;
+}
+
+
+/// <summary>
+/// store the token [begin, end) if there is room and count it
+/// </summary>
+static void addToken(Token* tokens,
+    std::size_t maxTokens,
+    std::size_t& numTokens,
+    const char* begin,
+    const char* end)
+{
+    if (numTokens < maxTokens) {
+        tokens[numTokens] = Token{ begin, static_cast<std::size_t>(end - begin) };
+    }
+    ++numTokens;
+}
+
+
+/// <summary>
+/// add the tokens that end at the spaces of a mask over block, the first one
+/// starting at tokenBegin; tokenBegin is left after the last space
+/// </summary>
+static void addTokens(std::uint64_t spaces,
+    const char* block,
+    Token* tokens,
+    std::size_t maxTokens,
+    std::size_t& numTokens,
+    const char*& tokenBegin)
+{
+    for (; spaces != 0; spaces &= spaces - 1) {
+        const char* delimiter = block + StructuralScanner::countTrailingZeros(spaces);
+        addToken(tokens, maxTokens, numTokens, tokenBegin, delimiter);
+        tokenBegin = delimiter + 1;
+    }
+}
+
+
+bool Token::equals(const char* text) const
+{
+    // compare with the literal's length, so that memcmp is expanded inline
+    std::size_t length = std::strlen(text);
+    return length == m_length && std::memcmp(m_begin, text, length) == 0;
+}
+
+
 std::vector<std::string> MessageProcessor::tokenizeMessage(const std::string& msg)
 {
     std::stringstream ss(msg);
@@ -30,15 +151,47 @@ std::vector<std::string> MessageProcessor::tokenizeMessage(const std::string& ms
 }
 
 
+std::size_t MessageProcessor::tokenizeMessage(const std::string& msg,
+    Token* tokens,
+    std::size_t maxTokens)
+{
+    // same splitting as getline on ' ': empty tokens between adjacent spaces are kept,
+    // a trailing space doesn't start a new token
+    std::size_t numTokens = 0;
+    const char* tokenBegin = msg.data();
+    const char* end = tokenBegin + msg.size();
+    for (const char* block = msg.data(); block < end; block += StructuralScanner::k_blockSize) {
+        std::size_t blockLength = std::min<std::size_t>(end - block, StructuralScanner::k_blockSize);
+        addTokens(StructuralScanner::scanBlock(block, blockLength).m_spaces,
+            block,
+            tokens,
+            maxTokens,
+            numTokens,
+            tokenBegin);
+    }
+    if (tokenBegin != end) {
+        addToken(tokens, maxTokens, numTokens, tokenBegin, end);
+    }
+    return numTokens;
+}
+
+
 bool MessageProcessor::getOrderSideFromToken(const std::string& token,
     OrderSide& orderSide)
 {
-    if (token == "BUY") {
+    return getOrderSideFromToken(Token{ token.data(), token.size() }, orderSide);
+}
+
+
+bool MessageProcessor::getOrderSideFromToken(const Token& token,
+    OrderSide& orderSide)
+{
+    if (token.equals("BUY")) {
         orderSide = OrderSide::BUY;
         return true;
     }
 
-    if (token == "SELL") {
+    if (token.equals("SELL")) {
         orderSide = OrderSide::SELL;
         return true;
     }
@@ -50,11 +203,18 @@ bool MessageProcessor::getOrderSideFromToken(const std::string& token,
 bool MessageProcessor::getOrderTypeFromToken(const std::string& token,
     OrderType& orderType)
 {
-    if (token == "IOC") {
+    return getOrderTypeFromToken(Token{ token.data(), token.size() }, orderType);
+}
+
+
+bool MessageProcessor::getOrderTypeFromToken(const Token& token,
+    OrderType& orderType)
+{
+    if (token.equals("IOC")) {
         orderType = OrderType::IOC;
         return true;
     }
-    if (token == "GFD") {
+    if (token.equals("GFD")) {
         orderType = OrderType::GFD;
         return true;
     }
@@ -65,26 +225,28 @@ bool MessageProcessor::getOrderTypeFromToken(const std::string& token,
 bool MessageProcessor::getPriceFromToken(const std::string& token,
     Price& price)
 {
-    try {
-        price = std::stoi(token);
-    }
-    catch (...) {
-        return false;
-    }
-    return true;
+    return getPriceFromToken(Token{ token.data(), token.size() }, price);
+}
+
+
+bool MessageProcessor::getPriceFromToken(const Token& token,
+    Price& price)
+{
+    return parseInteger(token, price);
 }
 
 
 bool MessageProcessor::getQuantityFromToken(const std::string& token,
     Quantity& quantity)
 {
-    try {
-        quantity = std::stoi(token);
-    }
-    catch (...) {
-        return false;
-    }
-    return true;
+    return getQuantityFromToken(Token{ token.data(), token.size() }, quantity);
+}
+
+
+bool MessageProcessor::getQuantityFromToken(const Token& token,
+    Quantity& quantity)
+{
+    return parseInteger(token, quantity);
 }
 
 
@@ -99,105 +261,303 @@ bool MessageProcessor::getOrderIdFromToken(std::string& token,
 }
 
 
-void MessageProcessor::listenToMessage(std::istream& is) const
+bool MessageProcessor::getOrderIdFromToken(const Token& token,
+    OrderId& orderId)
 {
-    std::string line;
-    while (true) {
-        getline(is, line, '\n');
-        
-        std::vector<std::string> tokens = tokenizeMessage(line);
-
-        if (!tokens.empty()) {
-            
-            // BUY or SELL
-            if (tokens[0] == "BUY" || tokens[0] == "SELL") {
-                // expect 5 tokens
-                if (tokens.size() != 5) {
-                    continue;
-                }
-
-                OrderSide orderSide;
-                bool success = getOrderSideFromToken(tokens[0], orderSide);
-                if (!success) {
-                    continue;
-                }
-                OrderType orderType;
-                success = getOrderTypeFromToken(tokens[1], orderType);
-                if (!success) {
-                    continue;
-                }
-                Price price;
-                success = getPriceFromToken(tokens[2], price);
-                if (!success) {
-                    continue;
-                }
-                Quantity quantity;
-                success = getQuantityFromToken(tokens[3], quantity);
-                if (!success) {
-                    continue;
-                }
-                OrderId orderId;
-                success = getOrderIdFromToken(tokens[4], orderId);
-                if (!success) {
-                    continue;
-                }
-
-                m_matchingEngineI->processOrder(orderType, orderSide, price, quantity, orderId);
+    if (token.m_length == 0) {
+        return false;
+    }
+    orderId.assign(token.m_begin, token.m_length);
+    return true;
+}
+
+
+bool MessageProcessor::isOrderMessage(const Token* tokens, std::size_t numTokens)
+{
+    return numTokens != 0 && (tokens[0].equals("BUY") || tokens[0].equals("SELL") ||
+        tokens[0].equals("MODIFY") || tokens[0].equals("CANCEL"));
+}
+
+
+/// <summary>
+/// returns true if OrderTracer samples the message split into tokens, only order
+/// messages are counted; while tracing is off this is one branch
+/// </summary>
+static bool isSampled(const Token* tokens, std::size_t numTokens)
+{
+    return OrderTracer::isSampling() && MessageProcessor::isOrderMessage(tokens, numTokens) &&
+        OrderTracer::sampleMessage();
+}
+
+
+void MessageProcessor::processMessage(const std::string& msg) const
+{
+    // whether a message is sampled depends on its first token, so a sampled
+    // message's parse span starts after tokenizing, as in processMessages
+    Token tokens[k_maxTokens];
+    std::size_t numTokens = tokenizeMessage(msg, tokens, k_maxTokens);
+    if (isSampled(tokens, numTokens)) {
+        executeTracedMessage(tokens, numTokens);
+        return;
+    }
+    executeMessage(tokens, numTokens, *m_matchingEngineI);
+}
+
+
+void MessageProcessor::processMessages(const char* data, std::size_t length) const
+{
+    // one pass over the structural chars of all lines, tokens are split like
+    // tokenizeMessage does and each line is executed as processMessage would
+    Token tokens[k_maxTokens];
+    std::size_t numTokens = 0;
+    const char* tokenBegin = data;
+    const char* end = data + length;
+    for (const char* block = data; block < end; block += StructuralScanner::k_blockSize) {
+        std::size_t blockLength = std::min<std::size_t>(end - block, StructuralScanner::k_blockSize);
+        StructuralMasks masks = StructuralScanner::scanBlock(block, blockLength);
+        std::uint64_t spaces = masks.m_spaces;
+        for (std::uint64_t newlines = masks.m_newlines; newlines != 0; newlines &= newlines - 1) {
+            unsigned offset = StructuralScanner::countTrailingZeros(newlines);
+            const char* newline = block + offset;
+
+            // the line's spaces in this block are the ones before its newline
+            std::uint64_t lineSpaces = spaces & ((static_cast<std::uint64_t>(1) << offset) - 1);
+            spaces ^= lineSpaces;
+            addTokens(lineSpaces, block, tokens, k_maxTokens, numTokens, tokenBegin);
+            if (tokenBegin != newline) {
+                addToken(tokens, k_maxTokens, numTokens, tokenBegin, newline);
             }
+            // a sampled line's parse span only covers converting its tokens,
+            // splitting them is shared with the rest of the block
+            if (isSampled(tokens, numTokens)) {
+                executeTracedMessage(tokens, numTokens);
+            }
+            else {
+                executeMessage(tokens, numTokens, *m_matchingEngineI);
+            }
+            numTokens = 0;
+            tokenBegin = newline + 1;
+        }
 
-            // CANCEL
-            if (tokens[0] == "CANCEL") {
-                // expect 2 tokens
-                if (tokens.size() != 2) {
-                    continue;
-                }
+        // the line goes on in the next block
+        addTokens(spaces, block, tokens, k_maxTokens, numTokens, tokenBegin);
+    }
+
+    // last line without a newline
+    if (tokenBegin != end) {
+        addToken(tokens, k_maxTokens, numTokens, tokenBegin, end);
+    }
+    if (numTokens == 0) {
+        return;
+    }
+    if (isSampled(tokens, numTokens)) {
+        executeTracedMessage(tokens, numTokens);
+    }
+    else {
+        executeMessage(tokens, numTokens, *m_matchingEngineI);
+    }
+}
 
-                OrderId orderId;
-                bool success = getOrderIdFromToken(tokens[1], orderId);
-                if (!success) {
-                    continue;
-                }
 
-                m_matchingEngineI->cancelOrder(orderId);
+void MessageProcessor::executeTracedMessage(const Token* tokens, std::size_t numTokens) const
+{
+    executeMessage(tokens, numTokens, *m_tracingMatchingEngine);
+    OrderTracer::endTrace();
+}
+
+
+void MessageProcessor::executeMessage(const Token* tokens,
+    std::size_t numTokens,
+    MatchingEngineI& matchingEngineI) const
+{
+    if (numTokens == 0) {
+        return;
+    }
+
+    // BUY or SELL
+    if (tokens[0].equals("BUY") || tokens[0].equals("SELL")) {
+        // expect 5 tokens
+        if (numTokens != 5) {
+            return;
+        }
+
+        OrderSide orderSide;
+        bool success = getOrderSideFromToken(tokens[0], orderSide);
+        if (!success) {
+            return;
+        }
+        OrderType orderType;
+        success = getOrderTypeFromToken(tokens[1], orderType);
+        if (!success) {
+            return;
+        }
+        Price price;
+        success = getPriceFromToken(tokens[2], price);
+        if (!success) {
+            return;
+        }
+        Quantity quantity;
+        success = getQuantityFromToken(tokens[3], quantity);
+        if (!success) {
+            return;
+        }
+        success = getOrderIdFromToken(tokens[4], m_orderId);
+        if (!success) {
+            return;
+        }
+
+        matchingEngineI.processOrder(orderType, orderSide, price, quantity, m_orderId);
+    }
+
+    // CANCEL
+    if (tokens[0].equals("CANCEL")) {
+        // expect 2 tokens
+        if (numTokens != 2) {
+            return;
+        }
+
+        bool success = getOrderIdFromToken(tokens[1], m_orderId);
+        if (!success) {
+            return;
+        }
+
+        matchingEngineI.cancelOrder(m_orderId);
+    }
+
+    // MODIFY
+    if (tokens[0].equals("MODIFY")) {
+        // expect 5 tokens
+        if (numTokens != 5) {
+            return;
+        }
+
+        bool success = getOrderIdFromToken(tokens[1], m_orderId);
+        if (!success) {
+            return;
+        }
+        OrderSide newOrderSide;
+        success = getOrderSideFromToken(tokens[2], newOrderSide);
+        if (!success) {
+            return;
+        }
+        Price newPrice;
+        success = getPriceFromToken(tokens[3], newPrice);
+        if (!success) {
+            return;
+        }
+        Quantity newQuantity;
+        success = getQuantityFromToken(tokens[4], newQuantity);
+        if (!success) {
+            return;
+        }
+
+        matchingEngineI.modifyOrder(m_orderId, newOrderSide, newPrice, newQuantity);
+    }
+
+    // MASSCANCEL
+    if (tokens[0].equals("MASSCANCEL")) {
+        // expect at least 3 tokens
+        if (numTokens < 3) {
+            return;
+        }
+
+        bool reportOrders;
+        if (tokens[1].equals("SIDE")) {
+            // MASSCANCEL SIDE side [DETAIL]
+            bool success = getDetailFlag(tokens, numTokens, 3, reportOrders);
+            if (!success) {
+                return;
+            }
+            OrderSide orderSide;
+            success = getOrderSideFromToken(tokens[2], orderSide);
+            if (!success) {
+                return;
             }
 
-            // MODIFY
-            if (tokens[0] == "MODIFY") {
-                // expect 5 tokens
-                if (tokens.size() != 5) {
-                    continue;
-                }
-
-                OrderId orderId;
-                bool success = getOrderIdFromToken(tokens[1], orderId);
-                if (!success) {
-                    continue;
-                }
-                OrderSide newOrderSide;
-                success = getOrderSideFromToken(tokens[2], newOrderSide);
-                if (!success) {
-                    continue;
-                }
-                Price newPrice;
-                success = getPriceFromToken(tokens[3], newPrice);
-                if (!success) {
-                    continue;
-                }
-                Quantity newQuantity;
-                success = getQuantityFromToken(tokens[4], newQuantity);
-                if (!success) {
-                    continue;
-                }
-                
-                m_matchingEngineI->modifyOrder(orderId, newOrderSide, newPrice, newQuantity);
+            matchingEngineI.cancelOrdersBySide(orderSide, reportOrders);
+        }
+        else if (tokens[1].equals("PRICE")) {
+            // MASSCANCEL PRICE side minPrice maxPrice [DETAIL]
+            bool success = getDetailFlag(tokens, numTokens, 5, reportOrders);
+            if (!success) {
+                return;
+            }
+            OrderSide orderSide;
+            success = getOrderSideFromToken(tokens[2], orderSide);
+            if (!success) {
+                return;
+            }
+            Price minPrice;
+            success = getPriceFromToken(tokens[3], minPrice);
+            if (!success) {
+                return;
+            }
+            Price maxPrice;
+            success = getPriceFromToken(tokens[4], maxPrice);
+            if (!success) {
+                return;
             }
 
-            // PRINT
-            if (tokens[0] == "PRINT") {
-                m_matchingEngineI->print();
+            matchingEngineI.cancelOrdersByPriceRange(orderSide, minPrice, maxPrice, reportOrders);
+        }
+        else if (tokens[1].equals("PREFIX")) {
+            // MASSCANCEL PREFIX orderIdPrefix [DETAIL]
+            bool success = getDetailFlag(tokens, numTokens, 3, reportOrders);
+            if (!success) {
+                return;
             }
+            success = getOrderIdFromToken(tokens[2], m_orderId);
+            if (!success) {
+                return;
+            }
+
+            matchingEngineI.cancelOrdersByIdPrefix(m_orderId, reportOrders);
         }
     }
+
+    // PRINT
+    if (tokens[0].equals("PRINT")) {
+        matchingEngineI.print();
+    }
+}
+
+
+void MessageProcessor::listenToMessage(std::istream& is) const
+{
+    // a line at a time while waiting for input, but whatever the stream has
+    // buffered already, e.g. when replaying a file, is parsed in one go
+    std::string line;
+    std::string lines;
+    lines.reserve(64 * 1024);
+    std::streambuf* input = is.rdbuf();
+    while (getline(is, line, '\n')) {
+        // lines may hold the start of this line, buffered with earlier ones
+        lines += line;
+        lines += '\n';
+        std::streamsize available = input->in_avail();
+        if (available > 0) {
+            std::size_t size = lines.size();
+            lines.resize(size + static_cast<std::size_t>(available));
+            lines.resize(size + static_cast<std::size_t>(input->sgetn(&lines[size], available)));
+        }
+
+        // complete lines only, a partial last one waits for the rest
+        std::size_t end = lines.rfind('\n') + 1;
+        processMessages(lines.data(), end);
+        lines.erase(0, end);
+    }
+
+    // the input ended in the middle of a line
+    processMessages(lines.data(), lines.size());
+}
+
+
+void MessageProcessor::reserve(std::size_t maxOrders,
+    std::size_t maxLevels,
+    std::size_t maxOrderIdLength)
+{
+    m_orderId.reserve(maxOrderIdLength);
+    m_matchingEngineI->reserve(maxOrders, maxLevels, maxOrderIdLength);
 }
 
-} // namespace matchingengine
\ No newline at end of file
+} // namespace matchingengine
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "MatchingEngineI.h"
+#include "OrderTracer.h"
 #include <memory>
 #include <iostream>
 #include <sstream>
@@ -9,25 +10,78 @@
 
 namespace matchingengine {
 
+/// <summary>
+/// a token is a range of characters inside the message it was cut from
+/// </summary>
+struct Token {
+    const char* m_begin;
+    std::size_t m_length;
+
+    /// <summary>
+    /// returns true if the token spells out text exactly
+    /// </summary>
+    bool equals(const char* text) const;
+};
+
+
 class MessageProcessor
 {
 private:
     std::shared_ptr<MatchingEngineI>  m_matchingEngineI;
 
+    // m_matchingEngineI as seen by sampled messages, see OrderTracer
+    std::shared_ptr<MatchingEngineI>  m_tracingMatchingEngine;
+
+    // scratch order ID reused by every message, so parsing doesn't allocate
+    mutable OrderId m_orderId;
+
+    /// <summary>
+    /// execute a message split into numTokens tokens, of which the first
+    /// k_maxTokens are in tokens, against matchingEngineI
+    /// </summary>
+    void executeMessage(const Token* tokens,
+        std::size_t numTokens,
+        MatchingEngineI& matchingEngineI) const;
+
+    /// <summary>
+    /// execute a message sampled by OrderTracer, recording its spans
+    /// </summary>
+    void executeTracedMessage(const Token* tokens, std::size_t numTokens) const;
+
 
 
 public:
+    /// <summary>
+    /// no message has more tokens than this
+    /// </summary>
+    static const std::size_t k_maxTokens = 8;
+
     /// <summary>
     /// ctor, inject dependency
     /// </summary>
     MessageProcessor(std::shared_ptr<MatchingEngineI> matchingEngineI) :
-        m_matchingEngineI(matchingEngineI) {}
+        m_matchingEngineI(matchingEngineI),
+        m_tracingMatchingEngine(std::make_shared<TracingMatchingEngine>(matchingEngineI)) {}
 
     /// <summary>
     /// parse message, return tokens
     /// </summary>
     static std::vector<std::string> tokenizeMessage(const std::string& msg);
 
+    /// <summary>
+    /// parse message into tokens pointing into msg, without allocating;
+    /// returns the number of tokens in msg, of which at most maxTokens are stored
+    /// </summary>
+    static std::size_t tokenizeMessage(const std::string& msg,
+        Token* tokens,
+        std::size_t maxTokens);
+
+    /// <summary>
+    /// returns true if the message split into numTokens tokens is about one order:
+    /// BUY, SELL, MODIFY or CANCEL; those are the messages OrderTracer samples
+    /// </summary>
+    static bool isOrderMessage(const Token* tokens, std::size_t numTokens);
+
     /// <summary>
     /// convert a token string to order side;
     /// function returns true if succeeds, o.w. false
@@ -35,6 +89,9 @@ public:
     static bool getOrderSideFromToken(const std::string& token,
         OrderSide& orderSide);
 
+    static bool getOrderSideFromToken(const Token& token,
+        OrderSide& orderSide);
+
     /// <summary>
     /// convert a token string to order type;
     /// function returns true if succeeds, o.w. false
@@ -42,20 +99,29 @@ public:
     static bool getOrderTypeFromToken(const std::string& token,
         OrderType& orderType);
 
+    static bool getOrderTypeFromToken(const Token& token,
+        OrderType& orderType);
+
     /// <summary>
-    /// convert a token string to price;
+    /// convert a token string to price, accepting what std::stoi accepts;
     /// function returns true if succeeds, o.w. false
     /// </summary>
     static bool getPriceFromToken(const std::string& token,
         Price& price);
 
+    static bool getPriceFromToken(const Token& token,
+        Price& price);
+
     /// <summary>
-    /// convert a token string to quantity;
+    /// convert a token string to quantity, accepting what std::stoi accepts;
     /// function returns true if succeeds, o.w. false
     /// </summary>
     static bool getQuantityFromToken(const std::string& token,
         Quantity& quantity);
 
+    static bool getQuantityFromToken(const Token& token,
+        Quantity& quantity);
+
     /// <summary>
     /// convert a token string to order ID;
     /// this function will steal token's resource;
@@ -65,10 +131,39 @@ public:
         OrderId& orderId);
 
     /// <summary>
-    /// listen to message, and parse message
+    /// copy a token to order ID, reusing orderId's capacity;
+    /// function returns true if succeeds, o.w. false
+    /// </summary>
+    static bool getOrderIdFromToken(const Token& token,
+        OrderId& orderId);
+
+    /// <summary>
+    /// parse one message and execute it against the matching engine;
+    /// once reserve() has been called this doesn't allocate
+    /// </summary>
+    void processMessage(const std::string& msg) const;
+
+    /// <summary>
+    /// parse and execute every message of a buffer of newline separated messages,
+    /// e.g. a replay file, scanning it in vector-sized blocks; executes exactly what
+    /// processMessage would for each line
+    /// </summary>
+    void processMessages(const char* data, std::size_t length) const;
+
+    /// <summary>
+    /// listen to message, and parse message, until the end of is; lines is has
+    /// buffered go through processMessages together
     /// </summary>
     void listenToMessage(std::istream& is) const;
 
+    /// <summary>
+    /// warm-up reservation for zero-allocation steady state: pre-size the matching
+    /// engine and the parser's scratch buffers
+    /// </summary>
+    void reserve(std::size_t maxOrders,
+        std::size_t maxLevels,
+        std::size_t maxOrderIdLength);
+
 };
 
 } // namespace matchingengine
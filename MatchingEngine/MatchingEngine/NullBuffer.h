@@ -0,0 +1,18 @@
+#pragma once
+
+#include <streambuf>
+
+namespace matchingengine {
+
+/// <summary>
+/// streambuf that swallows everything, to keep trade events off the console
+/// </summary>
+class NullBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c) override { return c; }
+
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+} // namespace matchingengine
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "MatchingEngineI.h"
+
+namespace matchingengine {
+
+/// <summary>
+/// matching engine that only counts the commands it gets, to time the parser alone
+/// </summary>
+class NullMatchingEngine : public MatchingEngineI
+{
+public:
+    NullMatchingEngine() : m_numCommands(0) {}
+
+    std::size_t numCommands() const { return m_numCommands; }
+
+    void print() const override { ++m_numCommands; }
+
+    void processOrder(OrderType, OrderSide, Price, Quantity, const OrderId&) override { ++m_numCommands; }
+
+    void purgeEngine() override { ++m_numCommands; }
+
+    void cancelOrder(const OrderId&) override { ++m_numCommands; }
+
+    void modifyOrder(const OrderId&, OrderSide, Price, Quantity) override { ++m_numCommands; }
+
+    void cancelOrdersBySide(OrderSide, bool) override { ++m_numCommands; }
+
+    void cancelOrdersByPriceRange(OrderSide, Price, Price, bool) override { ++m_numCommands; }
+
+    void cancelOrdersByIdPrefix(const OrderId&, bool) override { ++m_numCommands; }
+
+    void reserve(std::size_t, std::size_t, std::size_t) override {}
+
+    MemoryUsage memoryUsage() const override { return MemoryUsage(); }
+
+    void compact() override {}
+
+private:
+    mutable std::size_t m_numCommands;
+};
+
+} // namespace matchingengine
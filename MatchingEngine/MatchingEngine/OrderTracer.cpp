@@ -0,0 +1,443 @@
+#include "OrderTracer.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+
+namespace matchingengine {
+
+const std::size_t TraceSpan::k_maxOrderIdLength;
+const std::size_t TraceBuffer::k_capacity;
+
+std::atomic<std::size_t> OrderTracer::s_sampleEvery(0);
+thread_local std::size_t OrderTracer::s_numMessages = 0;
+thread_local std::uint64_t OrderTracer::s_traceId = 0;
+
+
+// the flusher drains the trace buffers this often
+static const std::chrono::milliseconds k_flushInterval(10);
+
+// state of the calling thread's sampled message
+static thread_local long long s_messageBeginNs = 0;
+static thread_local bool s_parsed = false;
+static thread_local char s_orderId[TraceSpan::k_maxOrderIdLength + 1] = {};
+
+// the calling thread's trace buffer, created on its first sampled message
+static thread_local TraceBuffer* s_traceBuffer = nullptr;
+
+// ids of the sampled messages, unique across threads
+static std::atomic<std::uint64_t> s_numTraces(0);
+
+// guards everything below, the traced threads only take it to add a buffer
+static std::mutex s_mutex;
+static std::condition_variable s_flushCondition;
+static std::vector<std::unique_ptr<TraceBuffer>> s_traceBuffers;
+static std::size_t s_numNamedThreads = 0;
+static std::ofstream s_traceFile;
+static bool s_firstEvent = true;
+static long long s_startNs = 0;
+static std::size_t s_numWrittenSpans = 0;
+static bool s_stopping = false;
+static std::thread s_flushThread;
+
+
+// stops a trace still on at exit, which completes its file; being defined last,
+// it is destroyed before the state above
+static struct TraceStopper {
+    ~TraceStopper() { OrderTracer::stop(); }
+} s_traceStopper;
+
+
+TraceBuffer::TraceBuffer(unsigned threadId) :
+    m_spans(k_capacity),
+    m_threadId(threadId),
+    m_numDropped(0),
+    m_head(0),
+    m_tail(0)
+{
+}
+
+
+bool TraceBuffer::push(const TraceSpan& span)
+{
+    std::size_t head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail.load(std::memory_order_acquire) == k_capacity) {
+        m_numDropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    m_spans[head % k_capacity] = span;
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+
+bool TraceBuffer::pop(TraceSpan& span)
+{
+    std::size_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail == m_head.load(std::memory_order_acquire)) {
+        return false;
+    }
+    span = m_spans[tail % k_capacity];
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+
+/// <summary>
+/// write a time of the trace clock in microseconds, the unit of the trace format
+/// </summary>
+static void writeMicroseconds(std::ostream& os, long long ns)
+{
+    char fraction[4] = { static_cast<char>('0' + ns / 100 % 10),
+        static_cast<char>('0' + ns / 10 % 10),
+        static_cast<char>('0' + ns % 10),
+        '\0' };
+    os << ns / 1000 << '.' << fraction;
+}
+
+
+/// <summary>
+/// write text as the body of a JSON string
+/// </summary>
+static void writeJsonString(std::ostream& os, const char* text)
+{
+    for (; *text != '\0'; ++text) {
+        unsigned char c = static_cast<unsigned char>(*text);
+        if (c == '"' || c == '\\') {
+            os << '\\' << *text;
+        }
+        else if (c < 0x20) {
+            const char* hexDigits = "0123456789abcdef";
+            os << "\\u00" << hexDigits[c >> 4] << hexDigits[c & 15];
+        }
+        else {
+            os << *text;
+        }
+    }
+}
+
+
+/// <summary>
+/// start a new event of the trace file's event array
+/// </summary>
+static void beginEvent()
+{
+    s_traceFile << (s_firstEvent ? "\n" : ",\n");
+    s_firstEvent = false;
+}
+
+
+/// <summary>
+/// write out the spans buffered so far, naming threads seen for the first time;
+/// must be called with s_mutex held
+/// </summary>
+static void writeSpans()
+{
+    for (; s_numNamedThreads < s_traceBuffers.size(); ++s_numNamedThreads) {
+        beginEvent();
+        s_traceFile << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+            << s_traceBuffers[s_numNamedThreads]->threadId()
+            << ",\"args\":{\"name\":\"engine thread "
+            << s_traceBuffers[s_numNamedThreads]->threadId() << "\"}}";
+    }
+
+    TraceSpan span;
+    for (const auto& traceBuffer : s_traceBuffers) {
+        while (traceBuffer->pop(span)) {
+            beginEvent();
+            s_traceFile << "{\"name\":\"" << span.m_name
+                << "\",\"cat\":\"order\",\"ph\":\"X\",\"pid\":1,\"tid\":" << traceBuffer->threadId()
+                << ",\"ts\":";
+            writeMicroseconds(s_traceFile, span.m_beginNs - s_startNs);
+            s_traceFile << ",\"dur\":";
+            writeMicroseconds(s_traceFile, span.m_durationNs);
+            s_traceFile << ",\"args\":{\"trace\":" << span.m_traceId;
+            if (span.m_valueName != nullptr) {
+                s_traceFile << ",\"" << span.m_valueName << "\":" << span.m_value;
+            }
+            if (span.m_orderId[0] != '\0') {
+                s_traceFile << ",\"orderId\":\"";
+                writeJsonString(s_traceFile, span.m_orderId);
+                s_traceFile << '"';
+            }
+            s_traceFile << "}}";
+            ++s_numWrittenSpans;
+        }
+    }
+
+    // so that the file is usable while the process runs, or after it dies
+    s_traceFile.flush();
+}
+
+
+/// <summary>
+/// flusher thread, writes out the trace buffers every k_flushInterval until stopped
+/// </summary>
+static void flushSpans()
+{
+    std::unique_lock<std::mutex> lock(s_mutex);
+    while (!s_stopping) {
+        s_flushCondition.wait_for(lock, k_flushInterval);
+        writeSpans();
+    }
+}
+
+
+bool OrderTracer::start(const std::string& fileName, std::size_t sampleEvery)
+{
+    if (sampleEvery == 0) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (s_flushThread.joinable()) {
+        return false;
+    }
+    s_traceFile.open(fileName.c_str(), std::ios::out | std::ios::trunc);
+    if (!s_traceFile) {
+        s_traceFile.clear();
+        return false;
+    }
+
+    // spans left over from an earlier trace don't belong in this file
+    TraceSpan span;
+    for (const auto& traceBuffer : s_traceBuffers) {
+        while (traceBuffer->pop(span)) {
+        }
+    }
+
+    // a JSON array of events; the trace format lets the closing bracket be
+    // missing, so a trace cut short is still readable
+    s_traceFile << '[';
+    s_firstEvent = true;
+    s_numNamedThreads = 0;
+    s_numWrittenSpans = 0;
+    s_startNs = now();
+    s_stopping = false;
+    s_flushThread = std::thread(flushSpans);
+    s_sampleEvery.store(sampleEvery, std::memory_order_relaxed);
+    return true;
+}
+
+
+void OrderTracer::stop()
+{
+    s_sampleEvery.store(0, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        if (!s_flushThread.joinable()) {
+            return;
+        }
+        s_stopping = true;
+    }
+    s_flushCondition.notify_one();
+    s_flushThread.join();
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    writeSpans();
+    s_traceFile << "\n]\n";
+    s_traceFile.close();
+}
+
+
+std::size_t OrderTracer::numWrittenSpans()
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return s_numWrittenSpans;
+}
+
+
+std::size_t OrderTracer::numDroppedSpans()
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    std::size_t numDropped = 0;
+    for (const auto& traceBuffer : s_traceBuffers) {
+        numDropped += traceBuffer->numDropped();
+    }
+    return numDropped;
+}
+
+
+/// <summary>
+/// create the calling thread's trace buffer, if it has none yet
+/// </summary>
+static void addTraceBuffer()
+{
+    if (s_traceBuffer == nullptr) {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        s_traceBuffers.emplace_back(new TraceBuffer(static_cast<unsigned>(s_traceBuffers.size() + 1)));
+        s_traceBuffer = s_traceBuffers.back().get();
+    }
+}
+
+
+void OrderTracer::beginTrace()
+{
+    // before the clock starts, so that the first trace doesn't time it
+    addTraceBuffer();
+    s_numMessages = 0;
+    s_traceId = s_numTraces.fetch_add(1, std::memory_order_relaxed) + 1;
+    s_messageBeginNs = now();
+    s_parsed = false;
+    s_orderId[0] = '\0';
+}
+
+
+void OrderTracer::endParse()
+{
+    if (!s_parsed) {
+        s_parsed = true;
+        record("parse", nullptr, 0, s_messageBeginNs);
+    }
+}
+
+
+void OrderTracer::setOrderId(const OrderId& orderId)
+{
+    std::size_t length = std::min(orderId.size(), TraceSpan::k_maxOrderIdLength);
+    std::memcpy(s_orderId, orderId.data(), length);
+    s_orderId[length] = '\0';
+}
+
+
+void OrderTracer::endTrace()
+{
+    // a message that never reached the engine was all parsing
+    endParse();
+
+    TraceSpan span;
+    span.m_name = "message";
+    span.m_valueName = nullptr;
+    span.m_value = 0;
+    span.m_beginNs = s_messageBeginNs;
+    span.m_durationNs = now() - s_messageBeginNs;
+    span.m_traceId = s_traceId;
+    std::memcpy(span.m_orderId, s_orderId, sizeof(span.m_orderId));
+    s_traceBuffer->push(span);
+
+    s_traceId = 0;
+}
+
+
+void OrderTracer::record(const char* name, const char* valueName, long long value, long long beginNs)
+{
+    TraceSpan span;
+    span.m_name = name;
+    span.m_valueName = valueName;
+    span.m_value = value;
+    span.m_beginNs = beginNs;
+    span.m_durationNs = now() - beginNs;
+    span.m_traceId = s_traceId;
+    span.m_orderId[0] = '\0';
+    s_traceBuffer->push(span);
+}
+
+
+TracingMatchingEngine::TracingMatchingEngine(std::shared_ptr<MatchingEngineI> matchingEngineI) :
+    m_matchingEngineI(matchingEngineI)
+{
+}
+
+
+void TracingMatchingEngine::print() const
+{
+    OrderTracer::endParse();
+    TraceScope<> scope("print");
+    m_matchingEngineI->print();
+}
+
+
+void TracingMatchingEngine::processOrder(OrderType orderType,
+    OrderSide orderSide,
+    Price price,
+    Quantity quantity,
+    const OrderId& orderId)
+{
+    OrderTracer::endParse();
+    OrderTracer::setOrderId(orderId);
+    TraceScope<> scope("processOrder", "price", price);
+    m_matchingEngineI->processOrderTraced(orderType, orderSide, price, quantity, orderId);
+}
+
+
+void TracingMatchingEngine::purgeEngine()
+{
+    OrderTracer::endParse();
+    TraceScope<> scope("purgeEngine");
+    m_matchingEngineI->purgeEngine();
+}
+
+
+void TracingMatchingEngine::cancelOrder(const OrderId& orderId)
+{
+    OrderTracer::endParse();
+    OrderTracer::setOrderId(orderId);
+    TraceScope<> scope("cancelOrder");
+    m_matchingEngineI->cancelOrder(orderId);
+}
+
+
+void TracingMatchingEngine::modifyOrder(const OrderId& orderId,
+    OrderSide newOrderSide,
+    Price newPrice,
+    Quantity newQuantity)
+{
+    OrderTracer::endParse();
+    OrderTracer::setOrderId(orderId);
+    TraceScope<> scope("modifyOrder", "price", newPrice);
+    m_matchingEngineI->modifyOrder(orderId, newOrderSide, newPrice, newQuantity);
+}
+
+
+void TracingMatchingEngine::cancelOrdersBySide(OrderSide orderSide, bool reportOrders)
+{
+    OrderTracer::endParse();
+    TraceScope<> scope("cancelOrdersBySide");
+    m_matchingEngineI->cancelOrdersBySide(orderSide, reportOrders);
+}
+
+
+void TracingMatchingEngine::cancelOrdersByPriceRange(OrderSide orderSide,
+    Price minPrice,
+    Price maxPrice,
+    bool reportOrders)
+{
+    OrderTracer::endParse();
+    TraceScope<> scope("cancelOrdersByPriceRange", "minPrice", minPrice);
+    m_matchingEngineI->cancelOrdersByPriceRange(orderSide, minPrice, maxPrice, reportOrders);
+}
+
+
+void TracingMatchingEngine::cancelOrdersByIdPrefix(const OrderId& orderIdPrefix, bool reportOrders)
+{
+    OrderTracer::endParse();
+    OrderTracer::setOrderId(orderIdPrefix);
+    TraceScope<> scope("cancelOrdersByIdPrefix");
+    m_matchingEngineI->cancelOrdersByIdPrefix(orderIdPrefix, reportOrders);
+}
+
+
+void TracingMatchingEngine::reserve(std::size_t maxOrders,
+    std::size_t maxLevels,
+    std::size_t maxOrderIdLength)
+{
+    m_matchingEngineI->reserve(maxOrders, maxLevels, maxOrderIdLength);
+}
+
+
+MemoryUsage TracingMatchingEngine::memoryUsage() const
+{
+    return m_matchingEngineI->memoryUsage();
+}
+
+
+void TracingMatchingEngine::compact()
+{
+    m_matchingEngineI->compact();
+}
+
+} // namespace matchingengine
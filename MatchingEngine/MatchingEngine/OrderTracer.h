@@ -0,0 +1,280 @@
+#pragma once
+
+#include "MatchingEngineI.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace matchingengine {
+
+/// <summary>
+/// one timed step of a sampled message, e.g. parse, validate or a level touched;
+/// names are string literals, so a span is recorded without allocating
+/// </summary>
+struct TraceSpan {
+    static const std::size_t k_maxOrderIdLength = 23;
+
+    const char*   m_name;
+    const char*   m_valueName;      // name of m_value, nullptr if the span has none
+    long long     m_value;
+    long long     m_beginNs;
+    long long     m_durationNs;
+    std::uint64_t m_traceId;        // sampled message the span belongs to
+    char          m_orderId[k_maxOrderIdLength + 1];  // only set on the message span
+};
+
+
+/// <summary>
+/// Single producer, single consumer ring of spans, lock-free: the traced thread
+/// pushes, the flusher thread pops; spans pushed while the ring is full are
+/// dropped and counted rather than blocking the traced thread
+/// </summary>
+class TraceBuffer
+{
+public:
+    static const std::size_t k_capacity = 16 * 1024;
+
+    explicit TraceBuffer(unsigned threadId);
+
+    TraceBuffer(const TraceBuffer&) = delete;
+    TraceBuffer& operator=(const TraceBuffer&) = delete;
+
+    /// <summary>
+    /// producer side; function returns true if the span was stored, false if dropped
+    /// </summary>
+    bool push(const TraceSpan& span);
+
+    /// <summary>
+    /// consumer side; function returns true if a span was taken, false if empty
+    /// </summary>
+    bool pop(TraceSpan& span);
+
+    unsigned threadId() const { return m_threadId; }
+
+    std::size_t numDropped() const { return m_numDropped.load(std::memory_order_relaxed); }
+
+private:
+    std::vector<TraceSpan>   m_spans;
+    unsigned                 m_threadId;
+    std::atomic<std::size_t> m_numDropped;
+
+    // next slot to push, written by the producer only; the padding keeps the
+    // producer's and the consumer's index apart, on their own cache lines
+    char                     m_headPadding[64];
+    std::atomic<std::size_t> m_head;
+    // next slot to pop, written by the consumer only
+    char                     m_tailPadding[64];
+    std::atomic<std::size_t> m_tail;
+};
+
+
+/// <summary>
+/// Sampled per-order lifecycle tracing: one in every N order messages (BUY, SELL,
+/// MODIFY, CANCEL) is timed from parsing to output, each step recorded as a span
+/// into a per-thread TraceBuffer.
+/// A background thread drains the buffers into a trace file in the Chrome trace
+/// event format, which chrome://tracing and ui.perfetto.dev open; the file is
+/// readable even if the process dies before stop(). With sampling off, a message
+/// costs one predictable branch: only sampled messages go through
+/// TracingMatchingEngine, which takes the engine's traced code path
+/// </summary>
+class OrderTracer
+{
+public:
+    /// <summary>
+    /// start tracing one in every sampleEvery order messages into fileName;
+    /// function returns true if succeeds, false if the file can't be opened or
+    /// tracing is already on
+    /// </summary>
+    static bool start(const std::string& fileName, std::size_t sampleEvery);
+
+    /// <summary>
+    /// stop sampling, flush what is buffered and close the trace file
+    /// </summary>
+    static void stop();
+
+    /// <summary>
+    /// returns the number of spans written to the trace file since start()
+    /// </summary>
+    static std::size_t numWrittenSpans();
+
+    /// <summary>
+    /// returns the number of spans dropped because a buffer was full
+    /// </summary>
+    static std::size_t numDroppedSpans();
+
+    /// <summary>
+    /// returns true if tracing is on; checked before anything else is spent on sampling
+    /// </summary>
+    static bool isSampling();
+
+    /// <summary>
+    /// count an order message on the calling thread; function returns true if it
+    /// is sampled, in which case the trace is open until endTrace()
+    /// </summary>
+    static bool sampleMessage();
+
+    /// <summary>
+    /// close the parse span of the sampled message, once per message
+    /// </summary>
+    static void endParse();
+
+    /// <summary>
+    /// attach the order ID the sampled message is about to its message span
+    /// </summary>
+    static void setOrderId(const OrderId& orderId);
+
+    /// <summary>
+    /// record the message span and close the sampled message
+    /// </summary>
+    static void endTrace();
+
+    /// <summary>
+    /// record a span of the sampled message from beginNs until now
+    /// </summary>
+    static void record(const char* name, const char* valueName, long long value, long long beginNs);
+
+    /// <summary>
+    /// returns the time of the trace clock in nanoseconds
+    /// </summary>
+    static long long now();
+
+private:
+    static std::atomic<std::size_t> s_sampleEvery;
+    static thread_local std::size_t s_numMessages;
+    static thread_local std::uint64_t s_traceId;
+
+    /// <summary>
+    /// open a trace for the calling thread's current message
+    /// </summary>
+    static void beginTrace();
+};
+
+
+/// <summary>
+/// Times the enclosing scope as a span of the sampled message; only built where
+/// the calling thread is known to be in one, the engine's traced code path and
+/// TracingMatchingEngine, so it doesn't check. The disabled scope is empty, so
+/// engine code shared with the untraced path pays nothing for its probes
+/// </summary>
+template <bool enabled = true>
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name, const char* valueName = nullptr, long long value = 0) :
+        m_name(name),
+        m_valueName(valueName),
+        m_value(value),
+        m_beginNs(OrderTracer::now()) {}
+
+    ~TraceScope()
+    {
+        OrderTracer::record(m_name, m_valueName, m_value, m_beginNs);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* m_name;
+    const char* m_valueName;
+    long long   m_value;
+    long long   m_beginNs;
+};
+
+
+template <>
+class TraceScope<false>
+{
+public:
+    explicit TraceScope(const char*, const char* = nullptr, long long = 0) {}
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+};
+
+
+/// <summary>
+/// Decorates the MatchingEngineI of a sampled message: closes its parse span when
+/// the first command comes in, and times each command, with its order ID, around
+/// the engine's own spans, which it gets by calling processOrderTraced()
+/// </summary>
+class TracingMatchingEngine : public MatchingEngineI
+{
+public:
+    /// <summary>
+    /// ctor, inject the engine that executes the commands
+    /// </summary>
+    explicit TracingMatchingEngine(std::shared_ptr<MatchingEngineI> matchingEngineI);
+
+    void print() const override;
+
+    void processOrder(OrderType orderType,
+        OrderSide orderSide,
+        Price price,
+        Quantity quantity,
+        const OrderId& orderId) override;
+
+    void purgeEngine() override;
+
+    void cancelOrder(const OrderId& orderId) override;
+
+    void modifyOrder(const OrderId& orderId,
+        OrderSide newOrderSide,
+        Price newPrice,
+        Quantity newQuantity) override;
+
+    void cancelOrdersBySide(OrderSide orderSide, bool reportOrders) override;
+
+    void cancelOrdersByPriceRange(OrderSide orderSide,
+        Price minPrice,
+        Price maxPrice,
+        bool reportOrders) override;
+
+    void cancelOrdersByIdPrefix(const OrderId& orderIdPrefix, bool reportOrders) override;
+
+    void reserve(std::size_t maxOrders,
+        std::size_t maxLevels,
+        std::size_t maxOrderIdLength) override;
+
+    MemoryUsage memoryUsage() const override;
+
+    void compact() override;
+
+private:
+    std::shared_ptr<MatchingEngineI> m_matchingEngineI;
+};
+
+
+// the functions below run once per message, or per span, so they are inline
+
+inline bool OrderTracer::isSampling()
+{
+    // the one branch a message costs while tracing is off
+    return s_sampleEvery.load(std::memory_order_relaxed) != 0;
+}
+
+
+inline bool OrderTracer::sampleMessage()
+{
+    std::size_t sampleEvery = s_sampleEvery.load(std::memory_order_relaxed);
+    if (sampleEvery != 0 && ++s_numMessages >= sampleEvery) {
+        beginTrace();
+        return true;
+    }
+    return false;
+}
+
+
+inline long long OrderTracer::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace matchingengine
@@ -0,0 +1,199 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <map>
+#include <list>
+#include <unordered_map>
+#include <functional>
+#include <vector>
+
+#include <memory>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+#include "MatchingEngineI.h"
+
+namespace matchingengine {
+namespace reference {
+
+class Order {
+public:
+    OrderType m_orderType;
+    OrderSide m_orderSide;
+    Price     m_price;
+    Quantity  m_quantity;
+    OrderId   m_orderId;
+
+    Order(OrderType orderType,
+        OrderSide orderSide,
+        Price price,
+        Quantity quantity,
+        const OrderId& orderId) :
+        m_orderType(orderType),
+        m_orderSide(orderSide),
+        m_price(price),
+        m_quantity(quantity),
+        m_orderId(orderId) {}
+
+    /// <summary>
+    /// returns a string that prints out OrderType
+    /// </summary>
+    static std::string OrderTypeToString(OrderType orderType);
+
+    /// <summary>
+    /// returns a string that prints out OrderSide
+    /// </summary>
+    static std::string OrderSideToString(OrderSide orderSide);
+};
+
+
+
+
+/// <summary>
+/// Frozen copy of the original MatchingEngine, kept as the reference semantics that
+/// optimised engines are diffed against; only extended with the later interface
+/// calls, in the plainest possible way. Don't optimise this one
+/// </summary>
+class ReferenceMatchingEngine : public MatchingEngineI {
+
+public:
+
+    /// <summary>
+    /// execute message PRINT
+    /// </summary>
+    void print() const;
+
+    /// <summary>
+    /// process order, trade order against queued orders, update queued orders,
+    /// and add the remaining untraded part to engine
+    /// </summary>
+    void processOrder(OrderType orderType,
+        OrderSide orderSide,
+        Price price,
+        Quantity quantity,
+        const OrderId& orderId);
+
+    /// <summary>
+    /// purge mathing engine, delete all queued orders
+    /// </summary>
+    void purgeEngine();
+
+    /// <summary>
+    /// cancel order, remove order from engine; if orderId doesn't exist, no op
+    /// </summary>
+    void cancelOrder(const OrderId& orderId);
+
+    /// <summary>
+    /// modify order; if orderId doesn't exist, no op; if order type is IOC, no op
+    /// </summary>
+    void modifyOrder(const OrderId& orderId,
+        OrderSide newOrderSide,
+        Price newPrice,
+        Quantity newQuantity);
+
+    /// <summary>
+    /// cancel all orders on one side, one cancelOrder at a time
+    /// </summary>
+    void cancelOrdersBySide(OrderSide orderSide, bool reportOrders);
+
+    /// <summary>
+    /// cancel all orders on one side priced within [minPrice, maxPrice], one cancelOrder at a time
+    /// </summary>
+    void cancelOrdersByPriceRange(OrderSide orderSide,
+        Price minPrice,
+        Price maxPrice,
+        bool reportOrders);
+
+    /// <summary>
+    /// cancel all orders whose ID starts with orderIdPrefix, one cancelOrder at a time
+    /// </summary>
+    void cancelOrdersByIdPrefix(const OrderId& orderIdPrefix, bool reportOrders);
+
+    /// <summary>
+    /// no op, the reference engine doesn't pre-size anything
+    /// </summary>
+    void reserve(std::size_t maxOrders,
+        std::size_t maxLevels,
+        std::size_t maxOrderIdLength);
+
+    /// <summary>
+    /// returns all zeros, the reference engine doesn't account for its memory
+    /// </summary>
+    MemoryUsage memoryUsage() const;
+
+    /// <summary>
+    /// no op
+    /// </summary>
+    void compact();
+
+
+private:
+    using OrdersList = std::list<std::shared_ptr<Order> >;
+    using PriceMap = std::map<Price, OrdersList, std::greater<Price> >;
+
+    std::unordered_map<OrderId, std::shared_ptr<Order> > m_orderIdToOrder;
+
+    PriceMap m_priceMapBuy;
+    PriceMap m_priceMapSell;
+
+    /// <summary>
+    /// Insert order into a price map, no validation
+    /// </summary>
+    void insertIntoPriceMap(PriceMap& priceMap, std::shared_ptr<Order> order);
+
+    /// <summary>
+    /// print price and quanty summary of a price map
+    /// </summary>
+    void printPriceQuantitySummary(const PriceMap& priceMap, std::ostream& os) const;
+
+    /// <summary>
+    /// trade new order (sell) against all queued buy orders in m_priceMapBuy, this function
+    /// updated new order and m_priceMapBuy, but doesn't insert new order into matching engine
+    /// </summary>
+    void tradeSellOrder(std::shared_ptr<Order> newOrder);
+
+    /// <summary>
+    /// trade new order (buy) against all queued sell orders in m_priceMapSell, this function
+    /// updated new order and m_priceMapSell, but doesn't insert new order into matching engine
+    /// </summary>
+    void tradeBuyOrder(std::shared_ptr<Order> newOrder);
+
+    /// <summary>
+    /// erase an order from a price map
+    /// </summary>
+    void eraseOrderFromPriceMap(PriceMap& priceMap, Price price, const OrderId& orderId);
+
+    /// <summary>
+    /// function returns true if price, quantity, and orderId are valid, o.w. false
+    /// </summary>
+    bool isValidOrder(Price price, Quantity quantity, const OrderId& orderId) const;
+
+    /// <summary>
+    /// insert order, this function doesn't validate order
+    /// </summary>
+    void insertOrder(std::shared_ptr<Order> newOrder);
+
+    /// <summary>
+    /// function returns true if buy and sell orders are price cross, meaning
+    /// buy price is equal or higher than sell price
+    /// </summary>
+    bool isPriceCross(std::shared_ptr<Order> buyOrder,
+        std::shared_ptr<Order> sellOrder) const;
+
+    /// <summary>
+    /// print trade event to ostream
+    /// </summary>
+    void printTradeEvent(std::shared_ptr<Order> olderOrder,
+        std::shared_ptr<Order> newOrder,
+        Quantity tradeQuantity,
+        std::ostream& os) const;
+
+    /// <summary>
+    /// cancel orders in the given order, printing the mass cancel events
+    /// </summary>
+    void cancelOrders(const std::vector<std::shared_ptr<Order> >& orders, bool reportOrders);
+};
+
+} // namespace reference
+} // namespace matchingengine
\ No newline at end of file
@@ -0,0 +1,247 @@
+#include "ReferenceMessageProcessor.h"
+
+
+namespace matchingengine {
+namespace reference {
+
+
+std::vector<std::string> ReferenceMessageProcessor::tokenizeMessage(const std::string& msg)
+{
+    std::stringstream ss(msg);
+    std::vector<std::string> tokens;
+
+    std::string token;
+
+    while (getline(ss, token, ' ')) {
+        tokens.push_back(std::move(token));
+    }
+
+    return tokens;
+}
+
+
+bool ReferenceMessageProcessor::getOrderSideFromToken(const std::string& token,
+    OrderSide& orderSide)
+{
+    if (token == "BUY") {
+        orderSide = OrderSide::BUY;
+        return true;
+    }
+
+    if (token == "SELL") {
+        orderSide = OrderSide::SELL;
+        return true;
+    }
+
+    return false;
+}
+
+
+bool ReferenceMessageProcessor::getOrderTypeFromToken(const std::string& token,
+    OrderType& orderType)
+{
+    if (token == "IOC") {
+        orderType = OrderType::IOC;
+        return true;
+    }
+    if (token == "GFD") {
+        orderType = OrderType::GFD;
+        return true;
+    }
+    return false;
+}
+
+
+bool ReferenceMessageProcessor::getPriceFromToken(const std::string& token,
+    Price& price)
+{
+    try {
+        price = std::stoi(token);
+    }
+    catch (...) {
+        return false;
+    }
+    return true;
+}
+
+
+bool ReferenceMessageProcessor::getQuantityFromToken(const std::string& token,
+    Quantity& quantity)
+{
+    try {
+        quantity = std::stoi(token);
+    }
+    catch (...) {
+        return false;
+    }
+    return true;
+}
+
+
+bool ReferenceMessageProcessor::getOrderIdFromToken(std::string& token,
+    OrderId& orderId)
+{
+    if (token.empty()) {
+        return false;
+    }
+    orderId.swap(token);
+    return true;
+}
+
+
+void ReferenceMessageProcessor::processMessage(const std::string& msg) const
+{
+    std::vector<std::string> tokens = tokenizeMessage(msg);
+
+    if (tokens.empty()) {
+        return;
+    }
+
+    // BUY or SELL
+    if (tokens[0] == "BUY" || tokens[0] == "SELL") {
+        // expect 5 tokens
+        if (tokens.size() != 5) {
+            return;
+        }
+
+        OrderSide orderSide;
+        bool success = getOrderSideFromToken(tokens[0], orderSide);
+        if (!success) {
+            return;
+        }
+        OrderType orderType;
+        success = getOrderTypeFromToken(tokens[1], orderType);
+        if (!success) {
+            return;
+        }
+        Price price;
+        success = getPriceFromToken(tokens[2], price);
+        if (!success) {
+            return;
+        }
+        Quantity quantity;
+        success = getQuantityFromToken(tokens[3], quantity);
+        if (!success) {
+            return;
+        }
+        OrderId orderId;
+        success = getOrderIdFromToken(tokens[4], orderId);
+        if (!success) {
+            return;
+        }
+
+        m_matchingEngineI->processOrder(orderType, orderSide, price, quantity, orderId);
+    }
+
+    // CANCEL
+    if (tokens[0] == "CANCEL") {
+        // expect 2 tokens
+        if (tokens.size() != 2) {
+            return;
+        }
+
+        OrderId orderId;
+        bool success = getOrderIdFromToken(tokens[1], orderId);
+        if (!success) {
+            return;
+        }
+
+        m_matchingEngineI->cancelOrder(orderId);
+    }
+
+    // MODIFY
+    if (tokens[0] == "MODIFY") {
+        // expect 5 tokens
+        if (tokens.size() != 5) {
+            return;
+        }
+
+        OrderId orderId;
+        bool success = getOrderIdFromToken(tokens[1], orderId);
+        if (!success) {
+            return;
+        }
+        OrderSide newOrderSide;
+        success = getOrderSideFromToken(tokens[2], newOrderSide);
+        if (!success) {
+            return;
+        }
+        Price newPrice;
+        success = getPriceFromToken(tokens[3], newPrice);
+        if (!success) {
+            return;
+        }
+        Quantity newQuantity;
+        success = getQuantityFromToken(tokens[4], newQuantity);
+        if (!success) {
+            return;
+        }
+
+        m_matchingEngineI->modifyOrder(orderId, newOrderSide, newPrice, newQuantity);
+    }
+
+    // MASSCANCEL SIDE side [DETAIL]
+    // MASSCANCEL PRICE side minPrice maxPrice [DETAIL]
+    // MASSCANCEL PREFIX orderIdPrefix [DETAIL]
+    if (tokens[0] == "MASSCANCEL") {
+        // expect at least 3 tokens
+        if (tokens.size() < 3) {
+            return;
+        }
+
+        std::size_t numRequiredTokens = tokens[1] == "PRICE" ? 5 : 3;
+        bool reportOrders = tokens.size() == numRequiredTokens + 1 &&
+            tokens[numRequiredTokens] == "DETAIL";
+        if (tokens.size() != numRequiredTokens && !reportOrders) {
+            return;
+        }
+
+        if (tokens[1] == "SIDE") {
+            OrderSide orderSide;
+            bool success = getOrderSideFromToken(tokens[2], orderSide);
+            if (!success) {
+                return;
+            }
+
+            m_matchingEngineI->cancelOrdersBySide(orderSide, reportOrders);
+        }
+
+        if (tokens[1] == "PRICE") {
+            OrderSide orderSide;
+            bool success = getOrderSideFromToken(tokens[2], orderSide);
+            if (!success) {
+                return;
+            }
+            Price minPrice;
+            success = getPriceFromToken(tokens[3], minPrice);
+            if (!success) {
+                return;
+            }
+            Price maxPrice;
+            success = getPriceFromToken(tokens[4], maxPrice);
+            if (!success) {
+                return;
+            }
+
+            m_matchingEngineI->cancelOrdersByPriceRange(orderSide, minPrice, maxPrice, reportOrders);
+        }
+
+        if (tokens[1] == "PREFIX") {
+            OrderId orderIdPrefix;
+            bool success = getOrderIdFromToken(tokens[2], orderIdPrefix);
+            if (!success) {
+                return;
+            }
+
+            m_matchingEngineI->cancelOrdersByIdPrefix(orderIdPrefix, reportOrders);
+        }
+    }
+
+    // PRINT
+    if (tokens[0] == "PRINT") {
+        m_matchingEngineI->print();
+    }
+}
+
+} // namespace reference
+} // namespace matchingengine
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "MatchingEngineI.h"
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace matchingengine {
+namespace reference {
+
+/// <summary>
+/// Frozen copy of the original MessageProcessor: getline splits a message into
+/// std::string tokens and std::stoi converts prices and quantities. Kept as the
+/// reference parser that the optimised one is diffed against; only extended with
+/// the later MASSCANCEL messages, in the plainest possible way. Don't optimise this one
+/// </summary>
+class ReferenceMessageProcessor
+{
+private:
+    std::shared_ptr<MatchingEngineI>  m_matchingEngineI;
+
+public:
+    /// <summary>
+    /// ctor, inject dependency
+    /// </summary>
+    ReferenceMessageProcessor(std::shared_ptr<MatchingEngineI> matchingEngineI) :
+        m_matchingEngineI(matchingEngineI) {}
+
+    /// <summary>
+    /// parse message, return tokens
+    /// </summary>
+    static std::vector<std::string> tokenizeMessage(const std::string& msg);
+
+    /// <summary>
+    /// convert a token string to order side;
+    /// function returns true if succeeds, o.w. false
+    /// </summary>
+    static bool getOrderSideFromToken(const std::string& token,
+        OrderSide& orderSide);
+
+    /// <summary>
+    /// convert a token string to order type;
+    /// function returns true if succeeds, o.w. false
+    /// </summary>
+    static bool getOrderTypeFromToken(const std::string& token,
+        OrderType& orderType);
+
+    /// <summary>
+    /// convert a token string to price;
+    /// function returns true if succeeds, o.w. false
+    /// </summary>
+    static bool getPriceFromToken(const std::string& token,
+        Price& price);
+
+    /// <summary>
+    /// convert a token string to quantity;
+    /// function returns true if succeeds, o.w. false
+    /// </summary>
+    static bool getQuantityFromToken(const std::string& token,
+        Quantity& quantity);
+
+    /// <summary>
+    /// convert a token string to order ID;
+    /// this function will steal token's resource;
+    /// function returns true if succeeds, o.w. false
+    /// </summary>
+    static bool getOrderIdFromToken(std::string& token,
+        OrderId& orderId);
+
+    /// <summary>
+    /// parse one message and execute it against the matching engine
+    /// </summary>
+    void processMessage(const std::string& msg) const;
+
+};
+
+} // namespace reference
+} // namespace matchingengine
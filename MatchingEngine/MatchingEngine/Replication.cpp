@@ -0,0 +1,756 @@
+#include "Replication.h"
+#include "MatchingEngine.h"
+#include "TextFormat.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+
+namespace matchingengine {
+
+#ifdef _WIN32
+static const SocketHandle k_invalidSocket = INVALID_SOCKET;
+static const int k_sendFlags = 0;
+
+static void closeSocket(SocketHandle socketHandle)
+{
+    closesocket(socketHandle);
+}
+
+static void shutdownSend(SocketHandle socketHandle)
+{
+    shutdown(socketHandle, SD_SEND);
+}
+
+static void setNonBlocking(SocketHandle socketHandle)
+{
+    u_long nonBlocking = 1;
+    ioctlsocket(socketHandle, FIONBIO, &nonBlocking);
+}
+
+static bool wouldBlock()
+{
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+}
+
+/// <summary>
+/// winsock has to be started once per process before any socket call
+/// </summary>
+static void startSockets()
+{
+    static const bool started = []() {
+        WSADATA wsaData;
+        return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+    }();
+    (void)started;
+}
+#else
+static const SocketHandle k_invalidSocket = -1;
+// a backup that went away must not kill the primary with SIGPIPE
+static const int k_sendFlags = MSG_NOSIGNAL;
+
+static void closeSocket(SocketHandle socketHandle)
+{
+    close(socketHandle);
+}
+
+static void shutdownSend(SocketHandle socketHandle)
+{
+    shutdown(socketHandle, SHUT_WR);
+}
+
+static void setNonBlocking(SocketHandle socketHandle)
+{
+    fcntl(socketHandle, F_SETFL, fcntl(socketHandle, F_GETFL, 0) | O_NONBLOCK);
+}
+
+static bool wouldBlock()
+{
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+static void startSockets()
+{
+}
+#endif
+
+
+/// <summary>
+/// returns the loopback address for port
+/// </summary>
+static sockaddr_in loopbackAddress(unsigned short port)
+{
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return address;
+}
+
+
+/// <summary>
+/// disable Nagle, batching is done by the primary already
+/// </summary>
+static void setNoDelay(SocketHandle socketHandle)
+{
+    int noDelay = 1;
+    setsockopt(socketHandle, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+}
+
+
+/// <summary>
+/// function returns true if socketHandle is readable within timeout, o.w. false
+/// </summary>
+static bool waitReadable(SocketHandle socketHandle, std::chrono::microseconds timeout)
+{
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(socketHandle, &readSet);
+    timeval tv;
+    tv.tv_sec = static_cast<long>(timeout.count() / 1000000);
+    tv.tv_usec = static_cast<long>(timeout.count() % 1000000);
+    return select(static_cast<int>(socketHandle) + 1, &readSet, nullptr, nullptr, &tv) > 0;
+}
+
+
+/// <summary>
+/// send all of data; function returns true if succeeds, o.w. false
+/// </summary>
+static bool sendAll(SocketHandle socketHandle, const char* data, std::size_t length)
+{
+    while (length > 0) {
+        int sent = send(socketHandle, data, static_cast<int>(std::min<std::size_t>(length, 1 << 30)), k_sendFlags);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+
+/// <summary>
+/// send as much of data as the socket takes without blocking;
+/// returns the number of bytes sent, or -1 if the connection failed
+/// </summary>
+static long long sendSome(SocketHandle socketHandle, const char* data, std::size_t length)
+{
+    int sent = send(socketHandle, data, static_cast<int>(std::min<std::size_t>(length, 1 << 30)), k_sendFlags);
+    if (sent < 0) {
+        return wouldBlock() ? 0 : -1;
+    }
+    return sent;
+}
+
+
+/// <summary>
+/// close a connection with a reset rather than an orderly shutdown, for a peer
+/// that doesn't close its end in time
+/// </summary>
+static void resetSocket(SocketHandle socketHandle)
+{
+    linger reset;
+    reset.l_onoff = 1;
+    reset.l_linger = 0;
+    setsockopt(socketHandle, SOL_SOCKET, SO_LINGER, reinterpret_cast<const char*>(&reset), sizeof(reset));
+    closeSocket(socketHandle);
+}
+
+
+/// <summary>
+/// the line a dropped backup is sent in place of further commands
+/// </summary>
+static const char k_droppedLine[] = "DROPPED";
+
+
+const std::size_t ReplicationPrimary::k_batchBytes;
+const std::size_t ReplicationPrimary::k_maxPendingBytes;
+const std::size_t ReplicationPrimary::k_maxUnsentBytes;
+const std::chrono::microseconds ReplicationPrimary::k_flushInterval(100);
+const std::chrono::milliseconds ReplicationPrimary::k_shutdownTimeout(1000);
+
+
+ReplicationPrimary::ReplicationPrimary(std::shared_ptr<MatchingEngineI> matchingEngineI) :
+    m_matchingEngineI(matchingEngineI),
+    m_sequence(0),
+    m_listenSocket(k_invalidSocket),
+    m_stopping(false)
+{
+    // room for the command that goes past k_maxPendingBytes, so appending
+    // doesn't allocate
+    m_pending.reserve(k_maxPendingBytes + k_batchBytes);
+    m_sending.reserve(k_maxPendingBytes + k_batchBytes);
+}
+
+
+ReplicationPrimary::~ReplicationPrimary()
+{
+    m_stopping = true;
+    m_flushCondition.notify_one();
+    m_drainedCondition.notify_all();
+    if (m_acceptThread.joinable()) {
+        m_acceptThread.join();
+    }
+    if (m_sendThread.joinable()) {
+        m_sendThread.join();
+    }
+
+    if (m_listenSocket != k_invalidSocket) {
+        closeSocket(m_listenSocket);
+    }
+
+    // an orderly shutdown, which backups take as the primary going away
+    std::lock_guard<std::mutex> lock(m_backupsMutex);
+    for (auto& backup : m_backups) {
+        closeBackup(std::move(backup));
+    }
+    m_backups.clear();
+    while (!closeBackups()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+
+bool ReplicationPrimary::listen(unsigned short port)
+{
+    startSockets();
+
+    m_listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (m_listenSocket == k_invalidSocket) {
+        return false;
+    }
+
+    int reuseAddress = 1;
+    setsockopt(m_listenSocket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuseAddress), sizeof(reuseAddress));
+
+    sockaddr_in address = loopbackAddress(port);
+    if (bind(m_listenSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+        || ::listen(m_listenSocket, SOMAXCONN) != 0) {
+        closeSocket(m_listenSocket);
+        m_listenSocket = k_invalidSocket;
+        return false;
+    }
+
+    m_acceptThread = std::thread(&ReplicationPrimary::acceptBackups, this);
+    m_sendThread = std::thread(&ReplicationPrimary::sendBatches, this);
+    return true;
+}
+
+
+bool ReplicationPrimary::waitForBackups(std::size_t count, std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(m_backupsMutex);
+    return m_backupsCondition.wait_for(lock, timeout, [this, count]() { return m_backups.size() >= count; });
+}
+
+
+bool ReplicationPrimary::waitForAcks(std::chrono::milliseconds timeout)
+{
+    const long long target = sequence();
+    m_flushCondition.notify_one();
+
+    std::unique_lock<std::mutex> lock(m_backupsMutex);
+    return m_backupsCondition.wait_for(lock, timeout, [this, target]() {
+        return std::all_of(m_backups.cbegin(), m_backups.cend(), [target](const BackupConnection& backup) {
+            return backup.m_ackedSequence >= target;
+        });
+    });
+}
+
+
+long long ReplicationPrimary::sequence() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_sequence;
+}
+
+
+void ReplicationPrimary::acceptBackups()
+{
+    while (!m_stopping) {
+        if (!waitReadable(m_listenSocket, std::chrono::milliseconds(100))) {
+            continue;
+        }
+
+        SocketHandle backupSocket = accept(m_listenSocket, nullptr, nullptr);
+        if (backupSocket == k_invalidSocket) {
+            continue;
+        }
+        setNoDelay(backupSocket);
+        setNonBlocking(backupSocket);
+
+        BackupConnection backup{ backupSocket, std::string(), std::string(), 0, false,
+            std::chrono::steady_clock::time_point() };
+        backup.m_unsent.reserve(k_maxUnsentBytes);
+
+        std::lock_guard<std::mutex> lock(m_backupsMutex);
+        m_backups.push_back(std::move(backup));
+        m_backupsCondition.notify_all();
+    }
+}
+
+
+void ReplicationPrimary::sendBatches()
+{
+    while (true) {
+        bool stopping = m_stopping;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (!stopping) {
+                m_flushCondition.wait_for(lock, k_flushInterval, [this]() {
+                    return m_stopping || m_pending.size() >= k_batchBytes;
+                });
+            }
+            // double buffering, the hot path keeps appending while the batch is sent
+            m_pending.swap(m_sending);
+        }
+        m_drainedCondition.notify_all();
+
+        bool allSent = shipBatch();
+
+        if (stopping) {
+            // give backups a moment to read what they haven't yet, so that a
+            // clean shutdown leaves them with every command
+            const auto deadline = std::chrono::steady_clock::now() + k_shutdownTimeout;
+            while (!allSent && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                allSent = shipBatch();
+            }
+            break;
+        }
+    }
+}
+
+
+bool ReplicationPrimary::shipBatch()
+{
+    std::lock_guard<std::mutex> lock(m_backupsMutex);
+
+    bool changed = false;
+    bool allSent = true;
+    for (auto backup = m_backups.begin(); backup != m_backups.end();) {
+        if (backup->m_unsent.size() + m_sending.size() > k_maxUnsentBytes) {
+            // backup stalled, it can't catch up any more: it gets the rest of the
+            // command the socket took part of, then DROPPED, so that it doesn't take over
+            std::size_t lineEnd = backup->m_unsent.find('\n');
+            backup->m_unsent.erase(lineEnd == std::string::npos ? 0 : lineEnd + 1);
+            backup->m_unsent += k_droppedLine;
+            backup->m_unsent += '\n';
+            closeBackup(std::move(*backup));
+            backup = m_backups.erase(backup);
+            changed = true;
+            continue;
+        }
+
+        backup->m_unsent += m_sending;
+        long long sent = 0;
+        if (!backup->m_unsent.empty()) {
+            sent = sendSome(backup->m_socket, backup->m_unsent.data(), backup->m_unsent.size());
+        }
+        if (sent < 0) {
+            // backup is gone
+            closeSocket(backup->m_socket);
+            backup = m_backups.erase(backup);
+            changed = true;
+            continue;
+        }
+        backup->m_unsent.erase(0, static_cast<std::size_t>(sent));
+        allSent = allSent && backup->m_unsent.empty();
+
+        // acks are "ACK sequence" lines, only the latest one matters
+        char buffer[256];
+        while (waitReadable(backup->m_socket, std::chrono::microseconds(0))) {
+            int received = recv(backup->m_socket, buffer, sizeof(buffer), 0);
+            if (received <= 0) {
+                break;
+            }
+            backup->m_acks.append(buffer, received);
+        }
+        std::size_t lineEnd;
+        while ((lineEnd = backup->m_acks.find('\n')) != std::string::npos) {
+            if (backup->m_acks.compare(0, 4, "ACK ") == 0) {
+                backup->m_ackedSequence = std::atoll(backup->m_acks.c_str() + 4);
+                changed = true;
+            }
+            backup->m_acks.erase(0, lineEnd + 1);
+        }
+        ++backup;
+    }
+    m_sending.clear();
+    closeBackups();
+
+    if (changed) {
+        m_backupsCondition.notify_all();
+    }
+    return allSent;
+}
+
+
+void ReplicationPrimary::closeBackup(BackupConnection&& backup)
+{
+    backup.m_closeDeadline = std::chrono::steady_clock::now() + k_shutdownTimeout;
+    m_closingBackups.push_back(std::move(backup));
+}
+
+
+bool ReplicationPrimary::closeBackups()
+{
+    const auto now = std::chrono::steady_clock::now();
+    for (auto backup = m_closingBackups.begin(); backup != m_closingBackups.end();) {
+        bool closed = false;
+        if (!backup->m_unsent.empty()) {
+            long long sent = sendSome(backup->m_socket, backup->m_unsent.data(), backup->m_unsent.size());
+            if (sent < 0) {
+                closed = true;
+            }
+            else {
+                backup->m_unsent.erase(0, static_cast<std::size_t>(sent));
+            }
+        }
+        if (!closed && backup->m_unsent.empty() && !backup->m_sendShutdown) {
+            // the backup reads everything, then sees the end of the stream
+            shutdownSend(backup->m_socket);
+            backup->m_sendShutdown = true;
+        }
+
+        // acks no longer matter, but left unread they would make the close a reset
+        char buffer[256];
+        while (!closed && waitReadable(backup->m_socket, std::chrono::microseconds(0))) {
+            closed = recv(backup->m_socket, buffer, sizeof(buffer), 0) <= 0;
+        }
+
+        if (closed) {
+            closeSocket(backup->m_socket);
+        }
+        else if (now >= backup->m_closeDeadline) {
+            resetSocket(backup->m_socket);
+        }
+        else {
+            ++backup;
+            continue;
+        }
+        backup = m_closingBackups.erase(backup);
+    }
+    return m_closingBackups.empty();
+}
+
+
+std::string& ReplicationPrimary::beginCommand(std::unique_lock<std::mutex>& lock)
+{
+    if (m_pending.size() >= k_maxPendingBytes) {
+        // the sender is behind, wait for it to take the buffer rather than grow it
+        m_flushCondition.notify_one();
+        m_drainedCondition.wait(lock, [this]() {
+            return m_pending.size() < k_maxPendingBytes || m_stopping;
+        });
+    }
+    appendInteger(m_pending, ++m_sequence);
+    m_pending += ' ';
+    return m_pending;
+}
+
+
+void ReplicationPrimary::endCommand()
+{
+    m_pending += '\n';
+    if (m_pending.size() >= k_batchBytes) {
+        m_flushCondition.notify_one();
+    }
+}
+
+
+void ReplicationPrimary::print() const
+{
+    m_matchingEngineI->print();
+}
+
+
+void ReplicationPrimary::processOrder(OrderType orderType,
+    OrderSide orderSide,
+    Price price,
+    Quantity quantity,
+    const OrderId& orderId)
+{
+    m_matchingEngineI->processOrder(orderType, orderSide, price, quantity, orderId);
+    replicateOrder(orderType, orderSide, price, quantity, orderId);
+}
+
+
+void ReplicationPrimary::processOrderTraced(OrderType orderType,
+    OrderSide orderSide,
+    Price price,
+    Quantity quantity,
+    const OrderId& orderId)
+{
+    m_matchingEngineI->processOrderTraced(orderType, orderSide, price, quantity, orderId);
+    replicateOrder(orderType, orderSide, price, quantity, orderId);
+}
+
+
+void ReplicationPrimary::replicateOrder(OrderType orderType,
+    OrderSide orderSide,
+    Price price,
+    Quantity quantity,
+    const OrderId& orderId)
+{
+    // replicated whether or not the engine accepted it, backups re-validate
+    // against the same book and come to the same decision
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::string& command = beginCommand(lock);
+    command += Order::OrderSideToString(orderSide);
+    command += ' ';
+    command += Order::OrderTypeToString(orderType);
+    command += ' ';
+    appendInteger(command, price);
+    command += ' ';
+    appendInteger(command, quantity);
+    command += ' ';
+    command += orderId;
+    endCommand();
+}
+
+
+void ReplicationPrimary::purgeEngine()
+{
+    m_matchingEngineI->purgeEngine();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    beginCommand(lock) += "PURGE";
+    endCommand();
+}
+
+
+void ReplicationPrimary::cancelOrder(const OrderId& orderId)
+{
+    m_matchingEngineI->cancelOrder(orderId);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::string& command = beginCommand(lock);
+    command += "CANCEL ";
+    command += orderId;
+    endCommand();
+}
+
+
+void ReplicationPrimary::modifyOrder(const OrderId& orderId,
+    OrderSide newOrderSide,
+    Price newPrice,
+    Quantity newQuantity)
+{
+    m_matchingEngineI->modifyOrder(orderId, newOrderSide, newPrice, newQuantity);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::string& command = beginCommand(lock);
+    command += "MODIFY ";
+    command += orderId;
+    command += ' ';
+    command += Order::OrderSideToString(newOrderSide);
+    command += ' ';
+    appendInteger(command, newPrice);
+    command += ' ';
+    appendInteger(command, newQuantity);
+    endCommand();
+}
+
+
+void ReplicationPrimary::cancelOrdersBySide(OrderSide orderSide, bool reportOrders)
+{
+    m_matchingEngineI->cancelOrdersBySide(orderSide, reportOrders);
+
+    // DETAIL only changes what is reported, backups apply the cancel without it
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::string& command = beginCommand(lock);
+    command += "MASSCANCEL SIDE ";
+    command += Order::OrderSideToString(orderSide);
+    endCommand();
+}
+
+
+void ReplicationPrimary::cancelOrdersByPriceRange(OrderSide orderSide,
+    Price minPrice,
+    Price maxPrice,
+    bool reportOrders)
+{
+    m_matchingEngineI->cancelOrdersByPriceRange(orderSide, minPrice, maxPrice, reportOrders);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::string& command = beginCommand(lock);
+    command += "MASSCANCEL PRICE ";
+    command += Order::OrderSideToString(orderSide);
+    command += ' ';
+    appendInteger(command, minPrice);
+    command += ' ';
+    appendInteger(command, maxPrice);
+    endCommand();
+}
+
+
+void ReplicationPrimary::cancelOrdersByIdPrefix(const OrderId& orderIdPrefix, bool reportOrders)
+{
+    m_matchingEngineI->cancelOrdersByIdPrefix(orderIdPrefix, reportOrders);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::string& command = beginCommand(lock);
+    command += "MASSCANCEL PREFIX ";
+    command += orderIdPrefix;
+    endCommand();
+}
+
+
+void ReplicationPrimary::reserve(std::size_t maxOrders,
+    std::size_t maxLevels,
+    std::size_t maxOrderIdLength)
+{
+    // sizing is local to each process, backups reserve for themselves
+    m_matchingEngineI->reserve(maxOrders, maxLevels, maxOrderIdLength);
+}
+
+
+MemoryUsage ReplicationPrimary::memoryUsage() const
+{
+    return m_matchingEngineI->memoryUsage();
+}
+
+
+void ReplicationPrimary::compact()
+{
+    // compaction doesn't change the book, so it isn't replicated either
+    m_matchingEngineI->compact();
+}
+
+
+ReplicationBackup::ReplicationBackup(std::shared_ptr<MatchingEngineI> matchingEngineI) :
+    m_matchingEngineI(matchingEngineI),
+    m_messageProcessor(matchingEngineI),
+    m_socket(k_invalidSocket),
+    m_appliedSequence(0)
+{
+}
+
+
+ReplicationBackup::~ReplicationBackup()
+{
+    if (m_socket != k_invalidSocket) {
+        closeSocket(m_socket);
+    }
+}
+
+
+bool ReplicationBackup::connect(unsigned short port)
+{
+    startSockets();
+
+    m_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (m_socket == k_invalidSocket) {
+        return false;
+    }
+
+    sockaddr_in address = loopbackAddress(port);
+    if (::connect(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        closeSocket(m_socket);
+        m_socket = k_invalidSocket;
+        return false;
+    }
+    setNoDelay(m_socket);
+    return true;
+}
+
+
+bool ReplicationBackup::applyCommand(const std::string& line)
+{
+    std::size_t delimiter = line.find(' ');
+    if (delimiter == std::string::npos) {
+        return false;
+    }
+
+    long long sequence = std::atoll(line.c_str());
+    if (sequence != m_appliedSequence + 1) {
+        // missed commands, this engine's book can't be trusted
+        return false;
+    }
+
+    if (line.compare(delimiter + 1, std::string::npos, "PURGE") == 0) {
+        m_matchingEngineI->purgeEngine();
+    }
+    else {
+        m_messageProcessor.processMessage(line.substr(delimiter + 1));
+    }
+    m_appliedSequence = sequence;
+    return true;
+}
+
+
+bool ReplicationBackup::run()
+{
+    if (m_socket == k_invalidSocket) {
+        return false;
+    }
+
+    bool consistent = receiveCommands();
+
+    // closing lets a primary that shuts down or drops this backup finish its close
+    closeSocket(m_socket);
+    m_socket = k_invalidSocket;
+    return consistent;
+}
+
+
+bool ReplicationBackup::receiveCommands()
+{
+    std::string received;
+    std::string line;
+    std::string ack;
+    char buffer[64 * 1024];
+    while (true) {
+        int length = recv(m_socket, buffer, sizeof(buffer), 0);
+        if (length <= 0) {
+            // primary is gone: shut down, or died, which may reset the connection
+            return true;
+        }
+        received.append(buffer, length);
+
+        // apply every complete line, keep a partial one for the next read
+        std::size_t lineBegin = 0;
+        std::size_t lineEnd;
+        while ((lineEnd = received.find('\n', lineBegin)) != std::string::npos) {
+            line.assign(received, lineBegin, lineEnd - lineBegin);
+            if (line == k_droppedLine || !applyCommand(line)) {
+                return false;
+            }
+            lineBegin = lineEnd + 1;
+        }
+        received.erase(0, lineBegin);
+
+        ack = "ACK ";
+        appendInteger(ack, m_appliedSequence);
+        ack += '\n';
+        if (!sendAll(m_socket, ack.data(), ack.size())) {
+            // the primary can't know this backup is in sync
+            return false;
+        }
+    }
+}
+
+
+long long ReplicationBackup::appliedSequence() const
+{
+    return m_appliedSequence;
+}
+
+} // namespace matchingengine
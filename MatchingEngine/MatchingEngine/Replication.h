@@ -0,0 +1,285 @@
+#pragma once
+
+#include "MatchingEngineI.h"
+#include "MessageProcessor.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace matchingengine {
+
+#ifdef _WIN32
+using SocketHandle = std::uintptr_t;
+#else
+using SocketHandle = int;
+#endif
+
+
+/// <summary>
+/// Primary side of primary/backup replication: decorates a MatchingEngineI, forwards
+/// every command to it and streams the state changing ones, sequenced, to backups
+/// connected over a loopback TCP socket. Commands are sent in the existing text
+/// protocol, one "sequence command" line each; PURGE stands for purgeEngine().
+/// Every state changing command is replicated, including ones the engine
+/// rejects: backups start from the same empty book and apply the same sequence,
+/// so their engines reject exactly the same commands and the books stay equal,
+/// without MatchingEngineI having to report what it accepted.
+/// The hot path only appends to a batch buffer, a sender thread ships the batch
+/// every k_flushInterval or once k_batchBytes are pending and collects acks.
+/// Sends never block: each backup has its own queue of unsent bytes, and a backup
+/// that lets it grow past k_maxUnsentBytes is dropped, so one stalled backup
+/// can't hold up the others; the hot path waits for the sender only if
+/// k_maxPendingBytes are pending, and otherwise doesn't allocate.
+/// A dropped backup is sent a DROPPED line after the last command it gets, which
+/// tells it not to take over; any other end of the stream, an orderly shutdown
+/// or the primary dying, promotes it. Connections are closed by shutting down
+/// the sending side and reading the backup's acks until it closes too, so that
+/// unread acks don't turn the close into a reset; a backup that doesn't read up
+/// to its DROPPED within k_shutdownTimeout is reset, and can't tell that apart
+/// from the primary dying
+/// </summary>
+class ReplicationPrimary : public MatchingEngineI
+{
+public:
+    static const std::size_t k_batchBytes = 16 * 1024;
+
+    /// <summary>
+    /// commands pending for the sender before the hot path waits for it
+    /// </summary>
+    static const std::size_t k_maxPendingBytes = 4 * k_batchBytes;
+
+    /// <summary>
+    /// bytes a backup may leave unread before it is dropped
+    /// </summary>
+    static const std::size_t k_maxUnsentBytes = 64 * k_batchBytes;
+
+    /// <summary>
+    /// ctor, inject the engine that executes the commands
+    /// </summary>
+    explicit ReplicationPrimary(std::shared_ptr<MatchingEngineI> matchingEngineI);
+
+    /// <summary>
+    /// dtor, ships what is pending and disconnects backups, which promotes them
+    /// </summary>
+    ~ReplicationPrimary();
+
+    ReplicationPrimary(const ReplicationPrimary&) = delete;
+    ReplicationPrimary& operator=(const ReplicationPrimary&) = delete;
+
+    /// <summary>
+    /// start accepting backups on 127.0.0.1:port;
+    /// function returns true if succeeds, o.w. false
+    /// </summary>
+    bool listen(unsigned short port);
+
+    /// <summary>
+    /// wait until count backups are connected; backups must connect before the first
+    /// command, a late one sees a sequence gap and refuses to apply anything;
+    /// function returns true if they connected within timeout, o.w. false
+    /// </summary>
+    bool waitForBackups(std::size_t count, std::chrono::milliseconds timeout);
+
+    /// <summary>
+    /// wait until every backup acknowledged every command replicated so far;
+    /// function returns true if they did within timeout, o.w. false
+    /// </summary>
+    bool waitForAcks(std::chrono::milliseconds timeout);
+
+    /// <summary>
+    /// returns the sequence number of the last command
+    /// </summary>
+    long long sequence() const;
+
+    void print() const;
+
+    void processOrder(OrderType orderType,
+        OrderSide orderSide,
+        Price price,
+        Quantity quantity,
+        const OrderId& orderId);
+
+    void processOrderTraced(OrderType orderType,
+        OrderSide orderSide,
+        Price price,
+        Quantity quantity,
+        const OrderId& orderId);
+
+    void purgeEngine();
+
+    void cancelOrder(const OrderId& orderId);
+
+    void modifyOrder(const OrderId& orderId,
+        OrderSide newOrderSide,
+        Price newPrice,
+        Quantity newQuantity);
+
+    void cancelOrdersBySide(OrderSide orderSide, bool reportOrders);
+
+    void cancelOrdersByPriceRange(OrderSide orderSide,
+        Price minPrice,
+        Price maxPrice,
+        bool reportOrders);
+
+    void cancelOrdersByIdPrefix(const OrderId& orderIdPrefix, bool reportOrders);
+
+    void reserve(std::size_t maxOrders,
+        std::size_t maxLevels,
+        std::size_t maxOrderIdLength);
+
+    MemoryUsage memoryUsage() const;
+
+    void compact();
+
+private:
+    static const std::chrono::microseconds k_flushInterval;
+    static const std::chrono::milliseconds k_shutdownTimeout;
+
+    struct BackupConnection {
+        SocketHandle m_socket;
+        std::string  m_unsent;           // batches the socket didn't take yet
+        std::string  m_acks;             // partial ack line received so far
+        long long    m_ackedSequence;
+        bool         m_sendShutdown;     // closing, everything was sent and the sending side shut down
+        std::chrono::steady_clock::time_point m_closeDeadline;  // closing, reset the connection after it
+    };
+
+    std::shared_ptr<MatchingEngineI> m_matchingEngineI;
+
+    // guards m_pending and m_sequence, the hot path only holds it to append
+    mutable std::mutex      m_mutex;
+    std::condition_variable m_flushCondition;
+    std::condition_variable m_drainedCondition;
+    std::string             m_pending;
+    std::string             m_sending;
+    long long               m_sequence;
+
+    // guards m_backups, shared by the acceptor and the sender
+    mutable std::mutex           m_backupsMutex;
+    std::condition_variable      m_backupsCondition;
+    std::vector<BackupConnection> m_backups;
+    std::vector<BackupConnection> m_closingBackups;     // dropped or shut down, not closed yet
+
+    SocketHandle      m_listenSocket;
+    std::atomic<bool> m_stopping;
+    std::thread       m_acceptThread;
+    std::thread       m_sendThread;
+
+    /// <summary>
+    /// start a replicated command, returns the buffer to append its text to;
+    /// lock must hold m_mutex, it is released while waiting for a full buffer
+    /// to be taken by the sender
+    /// </summary>
+    std::string& beginCommand(std::unique_lock<std::mutex>& lock);
+
+    /// <summary>
+    /// finish a replicated command, waking the sender if a batch is full;
+    /// must be called with m_mutex held
+    /// </summary>
+    void endCommand();
+
+    /// <summary>
+    /// replicate an order the engine has processed
+    /// </summary>
+    void replicateOrder(OrderType orderType,
+        OrderSide orderSide,
+        Price price,
+        Quantity quantity,
+        const OrderId& orderId);
+
+    /// <summary>
+    /// acceptor thread, adds backups as they connect
+    /// </summary>
+    void acceptBackups();
+
+    /// <summary>
+    /// sender thread, ships batches and collects acks until stopped
+    /// </summary>
+    void sendBatches();
+
+    /// <summary>
+    /// queue m_sending for every backup, send what their sockets take without
+    /// blocking and read whatever acks arrived; drops backups that failed or
+    /// fell k_maxUnsentBytes behind; function returns true if nothing is left unsent
+    /// </summary>
+    bool shipBatch();
+
+    /// <summary>
+    /// start closing backup within k_shutdownTimeout, moving it to m_closingBackups;
+    /// must be called with m_backupsMutex held
+    /// </summary>
+    void closeBackup(BackupConnection&& backup);
+
+    /// <summary>
+    /// send what closing backups haven't been sent yet, then shut down the sending
+    /// side and read until the backup closes; connections past their deadline are
+    /// reset; must be called with m_backupsMutex held; function returns true if
+    /// every connection is closed
+    /// </summary>
+    bool closeBackups();
+};
+
+
+/// <summary>
+/// Backup side of primary/backup replication: applies the command stream of a
+/// ReplicationPrimary to its own engine in sequence and acknowledges it; once the
+/// primary goes away the engine holds the primary's book and can take over
+/// </summary>
+class ReplicationBackup
+{
+public:
+    /// <summary>
+    /// ctor, inject the engine the replicated commands are applied to
+    /// </summary>
+    explicit ReplicationBackup(std::shared_ptr<MatchingEngineI> matchingEngineI);
+
+    ~ReplicationBackup();
+
+    ReplicationBackup(const ReplicationBackup&) = delete;
+    ReplicationBackup& operator=(const ReplicationBackup&) = delete;
+
+    /// <summary>
+    /// connect to a primary listening on 127.0.0.1:port;
+    /// function returns true if succeeds, o.w. false
+    /// </summary>
+    bool connect(unsigned short port);
+
+    /// <summary>
+    /// apply and acknowledge commands until the primary disconnects, then close
+    /// the connection; function returns true if the primary went away, by shutting
+    /// down or failing, with every command applied in sequence; false if a gap was
+    /// seen, the primary sent DROPPED or a command couldn't be acknowledged, in
+    /// which case the engine must not be promoted
+    /// </summary>
+    bool run();
+
+    /// <summary>
+    /// returns the sequence number of the last applied command
+    /// </summary>
+    long long appliedSequence() const;
+
+private:
+    std::shared_ptr<MatchingEngineI> m_matchingEngineI;
+    MessageProcessor m_messageProcessor;
+    SocketHandle m_socket;
+    long long    m_appliedSequence;
+
+    /// <summary>
+    /// apply one "sequence command" line;
+    /// function returns true if it was the next in sequence, o.w. false
+    /// </summary>
+    bool applyCommand(const std::string& line);
+
+    /// <summary>
+    /// the loop of run(), returns what run() returns
+    /// </summary>
+    bool receiveCommands();
+};
+
+} // namespace matchingengine
@@ -0,0 +1,198 @@
+#include "StructuralScanner.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MATCHINGENGINE_X86
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC lets any function use any intrinsic
+#define MATCHINGENGINE_TARGET(instructions)
+#else
+// gcc and clang compile a function for instructions beyond the build's baseline
+#define MATCHINGENGINE_TARGET(instructions) __attribute__((target(instructions)))
+#endif
+
+
+namespace matchingengine {
+
+const std::size_t StructuralScanner::k_blockSize;
+const std::size_t StructuralScanner::k_maxDigits;
+
+
+// instruction set in use, see StructuralScanner::setInstructionSet
+static InstructionSet s_instructionSet = StructuralScanner::supportedInstructionSet();
+
+
+/// <summary>
+/// returns one bit per char of the 8 char word, set where the char is c;
+/// chars are numbered from the lowest address, as on little endian CPUs
+/// </summary>
+static std::uint64_t matchWord(std::uint64_t word, char c)
+{
+    const std::uint64_t lowBits = 0x7F7F7F7F7F7F7F7Full;
+    std::uint64_t difference = word ^ (0x0101010101010101ull * static_cast<unsigned char>(c));
+    // high bit of every byte that is zero, without carries between bytes
+    std::uint64_t zeroBytes = ~(((difference & lowBits) + lowBits) | difference | lowBits);
+    // gather the 8 high bits into the top byte
+    return ((zeroBytes >> 7) * 0x0102040810204080ull) >> 56;
+}
+
+
+/// <summary>
+/// plain C++ version of StructuralScanner::scanBlock, 8 chars a step
+/// </summary>
+static StructuralMasks scanBlockScalar(const char* block, std::size_t length)
+{
+    StructuralMasks masks = { 0, 0 };
+    std::size_t i = 0;
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; i + 8 <= length; i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, block + i, sizeof(word));
+        masks.m_spaces |= matchWord(word, ' ') << i;
+        masks.m_newlines |= matchWord(word, '\n') << i;
+    }
+#endif
+    for (; i < length; ++i) {
+        masks.m_spaces |= static_cast<std::uint64_t>(block[i] == ' ') << i;
+        masks.m_newlines |= static_cast<std::uint64_t>(block[i] == '\n') << i;
+    }
+    return masks;
+}
+
+
+#ifdef MATCHINGENGINE_X86
+
+/// <summary>
+/// SSE version of StructuralScanner::scanBlock for a full block, 16 chars a step
+/// </summary>
+MATCHINGENGINE_TARGET("sse2")
+static StructuralMasks scanFullBlockSse2(const char* block)
+{
+    const __m128i spaces = _mm_set1_epi8(' ');
+    const __m128i newlines = _mm_set1_epi8('\n');
+    StructuralMasks masks = { 0, 0 };
+    for (std::size_t offset = 0; offset < StructuralScanner::k_blockSize; offset += 16) {
+        __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + offset));
+        masks.m_spaces |= static_cast<std::uint64_t>(
+            static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chars, spaces)))) << offset;
+        masks.m_newlines |= static_cast<std::uint64_t>(
+            static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chars, newlines)))) << offset;
+    }
+    return masks;
+}
+
+
+/// <summary>
+/// AVX2 version of StructuralScanner::scanBlock for a full block, 32 chars a step
+/// </summary>
+MATCHINGENGINE_TARGET("avx2")
+static StructuralMasks scanFullBlockAvx2(const char* block)
+{
+    const __m256i spaces = _mm256_set1_epi8(' ');
+    const __m256i newlines = _mm256_set1_epi8('\n');
+    __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+
+    StructuralMasks masks;
+    masks.m_spaces = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, spaces)))
+        | static_cast<std::uint64_t>(
+            static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, spaces)))) << 32;
+    masks.m_newlines = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, newlines)))
+        | static_cast<std::uint64_t>(
+            static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, newlines)))) << 32;
+    return masks;
+}
+
+#endif // MATCHINGENGINE_X86
+
+
+InstructionSet StructuralScanner::supportedInstructionSet()
+{
+#if defined(MATCHINGENGINE_X86) && defined(_MSC_VER)
+    int registers[4];
+    __cpuid(registers, 0);
+    const int maxLeaf = registers[0];
+    __cpuid(registers, 1);
+    const bool sse2 = (registers[3] & (1 << 26)) != 0;
+    // AVX2 also needs the OS to save the ymm registers
+    const bool osSavesYmm = (registers[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osSavesYmm) {
+        __cpuidex(registers, 7, 0);
+        avx2 = (registers[1] & (1 << 5)) != 0;
+    }
+    if (avx2) {
+        return InstructionSet::AVX2;
+    }
+    return sse2 ? InstructionSet::SSE2 : InstructionSet::SCALAR;
+#elif defined(MATCHINGENGINE_X86)
+    // may run before main, from a static initializer
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return InstructionSet::AVX2;
+    }
+    return __builtin_cpu_supports("sse2") ? InstructionSet::SSE2 : InstructionSet::SCALAR;
+#else
+    return InstructionSet::SCALAR;
+#endif
+}
+
+
+InstructionSet StructuralScanner::instructionSet()
+{
+    return s_instructionSet;
+}
+
+
+void StructuralScanner::setInstructionSet(InstructionSet instructionSet)
+{
+    InstructionSet supported = supportedInstructionSet();
+    s_instructionSet = static_cast<int>(instructionSet) <= static_cast<int>(supported) ?
+        instructionSet : supported;
+}
+
+
+const char* StructuralScanner::instructionSetToString(InstructionSet instructionSet)
+{
+    switch (instructionSet) {
+    case InstructionSet::SCALAR:
+        return "SCALAR";
+    case InstructionSet::SSE2:
+        return "SSE2";
+    case InstructionSet::AVX2:
+        return "AVX2";
+    default:
+        return "UNEXPECTED_INSTRUCTION_SET";
+    }
+}
+
+
+StructuralMasks StructuralScanner::scanBlock(const char* block, std::size_t length)
+{
+#ifdef MATCHINGENGINE_X86
+    if (s_instructionSet != InstructionSet::SCALAR) {
+        // a partial block is copied, the vector loads must not read past its end
+        char buffer[k_blockSize];
+        if (length < k_blockSize) {
+            std::memcpy(buffer, block, length);
+            std::memset(buffer + length, 0, k_blockSize - length);
+            block = buffer;
+        }
+        StructuralMasks masks = s_instructionSet == InstructionSet::AVX2 ?
+            scanFullBlockAvx2(block) : scanFullBlockSse2(block);
+        if (length < k_blockSize) {
+            // the padding after the block doesn't count
+            const std::uint64_t inBlock = (static_cast<std::uint64_t>(1) << length) - 1;
+            masks.m_spaces &= inBlock;
+            masks.m_newlines &= inBlock;
+        }
+        return masks;
+    }
+#endif
+    return scanBlockScalar(block, length);
+}
+
+} // namespace matchingengine
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace matchingengine {
+
+/// <summary>
+/// vector instructions the scanner may use, each level includes the ones before it
+/// </summary>
+enum class InstructionSet { SCALAR, SSE2, AVX2 };
+
+/// <summary>
+/// structural characters of a block of text, bit i stands for the i-th char
+/// </summary>
+struct StructuralMasks {
+    std::uint64_t m_spaces;
+    std::uint64_t m_newlines;
+};
+
+
+/// <summary>
+/// Vectorised front end of the text protocol: finds the spaces and newlines of
+/// 64 byte blocks at once, with AVX2, SSE2 or plain C++ picked at run time from
+/// what the CPU supports, and converts short runs of decimal digits 8 at a time
+/// inside a 64 bit register; every instruction set gives exactly the same results
+/// </summary>
+class StructuralScanner
+{
+public:
+    /// <summary>
+    /// number of chars scanned per block, one bit each in StructuralMasks
+    /// </summary>
+    static const std::size_t k_blockSize = 64;
+
+    /// <summary>
+    /// digit runs longer than this are left to the caller
+    /// </summary>
+    static const std::size_t k_maxDigits = 8;
+
+    /// <summary>
+    /// returns the best instruction set this CPU supports
+    /// </summary>
+    static InstructionSet supportedInstructionSet();
+
+    /// <summary>
+    /// returns the instruction set in use, the best supported one by default
+    /// </summary>
+    static InstructionSet instructionSet();
+
+    /// <summary>
+    /// use instructionSet, or the best supported one if the CPU lacks it;
+    /// not thread safe, meant for start-up and tests
+    /// </summary>
+    static void setInstructionSet(InstructionSet instructionSet);
+
+    /// <summary>
+    /// returns a string that prints out InstructionSet
+    /// </summary>
+    static const char* instructionSetToString(InstructionSet instructionSet);
+
+    /// <summary>
+    /// returns the masks of the first length (up to k_blockSize) chars of block
+    /// </summary>
+    static StructuralMasks scanBlock(const char* block, std::size_t length);
+
+    /// <summary>
+    /// convert the run of decimal digits at the start of [begin, begin + length) to
+    /// value and count them in numDigits; function returns false, leaving the
+    /// conversion to the caller, if the run is longer than k_maxDigits chars
+    /// </summary>
+    static bool parseDigits(const char* begin,
+        std::size_t length,
+        std::uint64_t& value,
+        std::size_t& numDigits);
+
+    /// <summary>
+    /// returns the index of the lowest set bit of a non-zero mask
+    /// </summary>
+    static unsigned countTrailingZeros(std::uint64_t mask);
+};
+
+
+// the functions below run once per token, so they are inline
+
+inline unsigned StructuralScanner::countTrailingZeros(std::uint64_t mask)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return static_cast<unsigned>(index);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if (_BitScanForward(&index, static_cast<unsigned long>(mask))) {
+        return static_cast<unsigned>(index);
+    }
+    _BitScanForward(&index, static_cast<unsigned long>(mask >> 32));
+    return static_cast<unsigned>(index) + 32;
+#else
+    return static_cast<unsigned>(__builtin_ctzll(mask));
+#endif
+}
+
+
+inline bool StructuralScanner::parseDigits(const char* begin,
+    std::size_t length,
+    std::uint64_t& value,
+    std::size_t& numDigits)
+{
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // up to 8 chars in one load, the first one in the lowest byte; nothing past
+    // the token is read
+    std::uint64_t word = 0;
+    std::memcpy(&word, begin, length < sizeof(word) ? length : sizeof(word));
+
+    // a byte is a digit if it is at most 9 after subtracting '0'; borrows and carries
+    // only spill into the bytes after the first non-digit, which don't count
+    std::uint64_t digits = word - 0x3030303030303030ull;
+    std::uint64_t nonDigits = (digits | (digits + 0x7676767676767676ull)) & 0x8080808080808080ull;
+    if (length < sizeof(word)) {
+        // the zero bytes after the token don't count
+        nonDigits |= ~static_cast<std::uint64_t>(0) << (8 * length);
+    }
+
+    if (nonDigits == 0) {
+        if (length > sizeof(word) && begin[sizeof(word)] >= '0' && begin[sizeof(word)] <= '9') {
+            return false;
+        }
+        numDigits = sizeof(word);
+    }
+    else {
+        numDigits = countTrailingZeros(nonDigits) / 8;
+        if (numDigits == 0) {
+            value = 0;
+            return true;
+        }
+        // right align the digits, dropping the rest
+        digits <<= 8 * (sizeof(word) - numDigits);
+    }
+
+    // 8 digits -> 4 two-digit -> 2 four-digit -> 1 eight-digit number
+    digits = (digits * (10 * 256 + 1)) >> 8 & 0x00FF00FF00FF00FFull;
+    digits = (digits * (100 * 65536 + 1)) >> 16 & 0x0000FFFF0000FFFFull;
+    value = (digits * (10000 * 4294967296ull + 1)) >> 32;
+    return true;
+#else
+    std::uint64_t digits = 0;
+    std::size_t i = 0;
+    for (; i < length && begin[i] >= '0' && begin[i] <= '9'; ++i) {
+        if (i == k_maxDigits) {
+            return false;
+        }
+        digits = digits * 10 + (begin[i] - '0');
+    }
+    value = digits;
+    numDigits = i;
+    return true;
+#endif
+}
+
+} // namespace matchingengine
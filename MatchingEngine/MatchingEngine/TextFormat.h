@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+
+namespace matchingengine {
+
+/// <summary>
+/// append the decimal form of value to text, same digits as ostream's operator<<
+/// but without locale or stream state, so it can build output in place
+/// </summary>
+inline void appendInteger(std::string& text, long long value)
+{
+    char digits[20];
+    int numDigits = 0;
+    unsigned long long magnitude = value < 0 ? 0ULL - static_cast<unsigned long long>(value)
+        : static_cast<unsigned long long>(value);
+    do {
+        digits[numDigits++] = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (value < 0) {
+        text += '-';
+    }
+    while (numDigits > 0) {
+        text += digits[--numDigits];
+    }
+}
+
+} // namespace matchingengine
@@ -1,5 +1,21 @@
 #include "MatchingEngine.h"
 #include "MessageProcessor.h"
+#ifdef MATCHINGENGINE_COUNT_ALLOCATIONS
+#include "AllocationCounter.h"
+#endif
+#include "DifferentialFuzzer.h"
+#include "LoadGenerator.h"
+#include "NullBuffer.h"
+#include "NullMatchingEngine.h"
+#include "OrderTracer.h"
+#include "ReferenceMatchingEngine.h"
+#include "Replication.h"
+#include "StructuralScanner.h"
+
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <thread>
 
 using namespace matchingengine;
 
@@ -27,8 +43,834 @@ void testListenToMessage() {
 }
 
 
-int main()
+#ifdef MATCHINGENGINE_COUNT_ALLOCATIONS
+
+/// <summary>
+/// replay a random workload of new orders, cancels, modifies and prints after a
+/// warm-up reservation for the book's peak, and fail if parse, match or output
+/// allocates; the reservation has little slack, so a leak in the memory pool's
+/// free lists shows up too; returns true if no allocation happened
+/// </summary>
+bool testZeroAllocation() {
+    const size_t numMessages = 200000;
+    const size_t maxOrderIdLength = 32;
+
+    // build the workload up front, its strings must not count
+    std::vector<std::string> messages;
+    messages.reserve(numMessages);
+    for (auto& timedMessage : LoadGenerator::makeSyntheticStream(numMessages, 1e6, 42)) {
+        messages.push_back(std::move(timedMessage.m_message));
+    }
+
+    NullBuffer nullBuffer;
+    std::streambuf* coutBuffer = std::cout.rdbuf(&nullBuffer);
+
+    // a dry run finds the most orders and levels that rest at once
+    size_t peakOrders = 0;
+    size_t peakLevels = 0;
+    {
+        auto matchingEngine = std::make_shared<MatchingEngine>();
+        MessageProcessor messageProcessor(matchingEngine);
+        for (const auto& message : messages) {
+            messageProcessor.processMessage(message);
+            const MemoryUsage memoryUsage = matchingEngine->memoryUsage();
+            peakOrders = std::max(peakOrders, memoryUsage.m_numOrders);
+            peakLevels = std::max(peakLevels, memoryUsage.m_numLevels);
+        }
+    }
+    const size_t maxOrders = peakOrders + peakOrders / 100 + 1;
+    const size_t maxLevels = peakLevels + peakLevels / 100 + 1;
+
+    MessageProcessor messageProcessor(std::make_shared<MatchingEngine>());
+    messageProcessor.reserve(maxOrders, maxLevels, maxOrderIdLength);
+
+    AllocationCounter::start();
+    for (const auto& message : messages) {
+        messageProcessor.processMessage(message);
+    }
+    size_t allocations = AllocationCounter::stop();
+
+    std::cout.rdbuf(coutBuffer);
+
+    std::cout << "zero allocation test: " << messages.size() << " messages, reserved for "
+        << maxOrders << " orders on " << maxLevels << " levels, "
+        << allocations << " allocations, "
+        << (allocations == 0 ? "PASSED" : "FAILED") << "\n";
+    return allocations == 0;
+}
+#endif
+
+
+void printMemoryUsage(const std::string& label, const MemoryUsage& memoryUsage) {
+    std::cout << label
+        << ": index " << memoryUsage.m_idIndexBytes
+        << ", levels " << memoryUsage.m_levelBytes
+        << ", orders " << memoryUsage.m_orderBytes
+        << ", strings " << memoryUsage.m_stringBytes
+        << ", pool reserved " << memoryUsage.m_poolReservedBytes
+        << ", pool free " << memoryUsage.m_poolFreeBytes << "\n";
+}
+
+
+/// <summary>
+/// fill a reserved engine, cancel most of the book, then compact it, printing the
+/// memory usage at every step; returns true if compact() released pool memory
+/// without changing the book
+/// </summary>
+bool testMemoryAccounting() {
+    auto matchingEngine = std::make_shared<MatchingEngine>();
+    MessageProcessor messageProcessor(matchingEngine);
+    messageProcessor.reserve(200000, 256, 32);
+    printMemoryUsage("reserved", matchingEngine->memoryUsage());
+
+    NullBuffer nullBuffer;
+    std::streambuf* coutBuffer = std::cout.rdbuf(&nullBuffer);
+    for (const auto& timedMessage : LoadGenerator::makeSyntheticStream(200000, 1e6, 42)) {
+        messageProcessor.processMessage(timedMessage.m_message);
+    }
+    std::cout.rdbuf(coutBuffer);
+    printMemoryUsage("filled", matchingEngine->memoryUsage());
+
+    std::cout.rdbuf(&nullBuffer);
+    matchingEngine->cancelOrdersBySide(OrderSide::BUY, false);
+    std::cout.rdbuf(coutBuffer);
+    printMemoryUsage("buy side cancelled", matchingEngine->memoryUsage());
+
+    std::ostringstream bookBefore;
+    std::cout.rdbuf(bookBefore.rdbuf());
+    matchingEngine->print();
+    std::cout.rdbuf(coutBuffer);
+
+    const MemoryUsage beforeCompact = matchingEngine->memoryUsage();
+    matchingEngine->compact();
+    const MemoryUsage afterCompact = matchingEngine->memoryUsage();
+    printMemoryUsage("compacted", afterCompact);
+
+    std::ostringstream bookAfter;
+    std::cout.rdbuf(bookAfter.rdbuf());
+    matchingEngine->print();
+    std::cout.rdbuf(coutBuffer);
+
+    bool passed = bookBefore.str() == bookAfter.str()
+        && afterCompact.m_poolReservedBytes < beforeCompact.m_poolReservedBytes;
+    std::cout << "memory accounting test: " << (passed ? "PASSED" : "FAILED") << "\n";
+    return passed;
+}
+
+
+/// <summary>
+/// replay a captured stream, or a synthetic one if captureFile is empty, open loop
+/// at increasing offered rates and print the latency vs offered load curve;
+/// returns false if the capture can't be read or has no rate to replay at
+/// </summary>
+bool testLoadGenerator(const std::string& captureFile) {
+    std::vector<TimedMessage> stream;
+    if (captureFile.empty()) {
+        stream = LoadGenerator::makeSyntheticStream(100000, 100000, 42);
+    }
+    else {
+        std::ifstream is(captureFile);
+        if (!is) {
+            std::cout << "can't read capture file " << captureFile << "\n";
+            return false;
+        }
+        stream = LoadGenerator::loadCapture(is);
+    }
+
+    auto engineFactory = [&stream]() {
+        auto matchingEngine = std::make_shared<MatchingEngine>();
+        matchingEngine->reserve(stream.size(), 256, 32);
+        return matchingEngine;
+    };
+
+    // the rate comes from the first and last timestamps, which must differ
+    const double recordedRate = LoadGenerator::recordedRate(stream);
+    if (recordedRate <= 0) {
+        std::cout << "capture " << captureFile << " has " << stream.size()
+            << " timestamped messages, at least two with different timestamps are needed\n";
+        return false;
+    }
+
+    std::vector<double> offeredRates;
+    for (double rateScale = 0.25; rateScale <= 64; rateScale *= 2) {
+        offeredRates.push_back(recordedRate * rateScale);
+    }
+
+    std::cout << "replaying " << stream.size() << " messages recorded at " << recordedRate << " msg/s\n";
+    LoadGenerator::printReports(LoadGenerator::sweep(stream, offeredRates, engineFactory), std::cout);
+    return true;
+}
+
+
+/// <summary>
+/// ways into MessageProcessor: getline and processMessage, processMessages on
+/// the whole buffer, or listenToMessage on a stream
+/// </summary>
+enum class FrontEnd { LINE_BY_LINE, BUFFER, LISTEN };
+
+
+/// <summary>
+/// parse buffer into messageProcessor through frontEnd
+/// </summary>
+void parseMessages(const MessageProcessor& messageProcessor, const std::string& buffer, FrontEnd frontEnd) {
+    switch (frontEnd) {
+    case FrontEnd::LINE_BY_LINE: {
+        std::istringstream is(buffer);
+        std::string line;
+        while (getline(is, line, '\n')) {
+            messageProcessor.processMessage(line);
+        }
+        break;
+    }
+    case FrontEnd::BUFFER:
+        messageProcessor.processMessages(buffer.data(), buffer.size());
+        break;
+    case FrontEnd::LISTEN: {
+        std::istringstream is(buffer);
+        messageProcessor.listenToMessage(is);
+        break;
+    }
+    }
+}
+
+
+/// <summary>
+/// speed-up of a vector instruction set over the scalar one, see measureSpeedUp
+/// </summary>
+struct SpeedUp {
+    double m_scalarRate;    // best of the scalar passes, per second
+    double m_vectorRate;    // best of the vector passes, per second
+    double m_speedUp;       // median of the per-pair ratios
+};
+
+
+/// <summary>
+/// time run, which handles numItems, with the scalar instruction set and with
+/// instructionSet in alternating pairs of passes, so that other load on the machine
+/// hits both alike; returns the best rates and the median of the per-pair speed-ups
+/// </summary>
+SpeedUp measureSpeedUp(const std::function<void()>& run, size_t numItems, InstructionSet instructionSet) {
+    const int numPasses = 21;
+    const InstructionSet instructionSets[] = { InstructionSet::SCALAR, instructionSet };
+    SpeedUp speedUp = { 0, 0, 0 };
+    std::vector<double> speedUps;
+    for (int pass = 0; pass < numPasses; ++pass) {
+        double rates[2];
+        for (int i = 0; i < 2; ++i) {
+            StructuralScanner::setInstructionSet(instructionSets[i]);
+            auto start = std::chrono::steady_clock::now();
+            run();
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            rates[i] = numItems / elapsed.count();
+        }
+        speedUp.m_scalarRate = std::max(speedUp.m_scalarRate, rates[0]);
+        speedUp.m_vectorRate = std::max(speedUp.m_vectorRate, rates[1]);
+        speedUps.push_back(rates[1] / rates[0]);
+    }
+    std::sort(speedUps.begin(), speedUps.end());
+    speedUp.m_speedUp = speedUps[speedUps.size() / 2];
+    return speedUp;
+}
+
+
+/// <summary>
+/// convert text like the scalar parser always did, with std::stoi;
+/// function returns true if succeeds, o.w. false
+/// </summary>
+bool stoiFromText(const std::string& text, int& value) {
+    try {
+        value = std::stoi(text);
+        return true;
+    }
+    catch (const std::logic_error&) {
+        return false;
+    }
+}
+
+
+/// <summary>
+/// returns on how many of numTexts random texts, made of the chars that matter to
+/// the parser, instructionSet splits tokens unlike getline or converts integers
+/// unlike std::stoi
+/// </summary>
+size_t countParseMismatches(InstructionSet instructionSet, size_t numTexts) {
+    StructuralScanner::setInstructionSet(instructionSet);
+
+    const std::string alphabet = "   \n\t\r+-0000123456789AB";
+    std::mt19937 random(42);
+    size_t mismatches = 0;
+    for (size_t i = 0; i < numTexts; ++i) {
+        std::string text(random() % 150, ' ');
+        for (char& c : text) {
+            c = alphabet[random() % alphabet.size()];
+        }
+
+        std::vector<std::string> expectedTokens = MessageProcessor::tokenizeMessage(text);
+        Token tokens[MessageProcessor::k_maxTokens];
+        size_t numTokens = MessageProcessor::tokenizeMessage(text, tokens, MessageProcessor::k_maxTokens);
+        bool same = numTokens == expectedTokens.size();
+
+        // every stored token, and the whole text, as an integer
+        const size_t numStoredTokens = std::min(numTokens, MessageProcessor::k_maxTokens);
+        expectedTokens.resize(numStoredTokens);
+        expectedTokens.push_back(text);
+        for (size_t j = 0; same && j < expectedTokens.size(); ++j) {
+            Token token = j < numStoredTokens ? tokens[j] : Token{ text.data(), text.size() };
+            same = std::string(token.m_begin, token.m_length) == expectedTokens[j];
+
+            int expectedValue = 0;
+            Price price = 0;
+            bool expectedParsed = stoiFromText(expectedTokens[j], expectedValue);
+            same = same
+                && MessageProcessor::getPriceFromToken(token, price) == expectedParsed
+                && (!expectedParsed || price == expectedValue);
+        }
+        mismatches += same ? 0 : 1;
+    }
+    return mismatches;
+}
+
+
+/// <summary>
+/// check that the vectorised parser splits, converts and executes exactly like the
+/// scalar one, on random text and on a replay stream, a capture or a synthetic one
+/// if captureFile is empty, then compare their speed on the stream; returns true
+/// if they agree, and the vector instructions scan blocks at least
+/// k_minScanSpeedUp and parse the buffer at least k_minParseSpeedUp times as fast
+/// </summary>
+bool testStructuralScanner(const std::string& captureFile) {
+    // 2x was asked of the whole parse, but scanning is only a fifth of it: the
+    // tokens still have to be converted and executed, the same work with either
+    // instruction set. The 2x applies to the scan, the whole parse must gain 10%
+    const double k_minScanSpeedUp = 2.0;
+    const double k_minParseSpeedUp = 1.1;
+    const InstructionSet instructionSet = StructuralScanner::supportedInstructionSet();
+    std::cout << "instruction set: " << StructuralScanner::instructionSetToString(instructionSet) << "\n";
+
+    size_t mismatches = 0;
+    for (InstructionSet candidate : { InstructionSet::SCALAR, InstructionSet::SSE2, InstructionSet::AVX2 }) {
+        if (static_cast<int>(candidate) <= static_cast<int>(instructionSet)) {
+            size_t candidateMismatches = countParseMismatches(candidate, 100000);
+            std::cout << "random text, " << StructuralScanner::instructionSetToString(candidate)
+                << ": " << candidateMismatches << " mismatches\n";
+            mismatches += candidateMismatches;
+        }
+    }
+
+    std::vector<TimedMessage> stream;
+    if (captureFile.empty()) {
+        stream = LoadGenerator::makeSyntheticStream(200000, 1e6, 42);
+    }
+    else {
+        std::ifstream is(captureFile);
+        if (!is) {
+            std::cout << "can't read capture file " << captureFile << "\n";
+            return false;
+        }
+        stream = LoadGenerator::loadCapture(is);
+    }
+    std::string buffer;
+    for (const auto& timedMessage : stream) {
+        buffer += timedMessage.m_message;
+        buffer += '\n';
+    }
+
+    // the same events and books, line by line with the scalar parser, and with the
+    // vectorised one in one go and through listenToMessage
+    const FrontEnd frontEnds[] = { FrontEnd::LINE_BY_LINE, FrontEnd::BUFFER, FrontEnd::LISTEN };
+    std::streambuf* coutBuffer = std::cout.rdbuf();
+    std::ostringstream outputs[3];
+    for (int i = 0; i < 3; ++i) {
+        StructuralScanner::setInstructionSet(i == 0 ? InstructionSet::SCALAR : instructionSet);
+        MessageProcessor messageProcessor(std::make_shared<MatchingEngine>());
+        std::cout.rdbuf(outputs[i].rdbuf());
+        parseMessages(messageProcessor, buffer, frontEnds[i]);
+        std::cout.rdbuf(coutBuffer);
+    }
+    bool sameOutput = outputs[0].str() == outputs[1].str() && outputs[0].str() == outputs[2].str();
+    std::cout << "replay of " << stream.size() << " messages: output "
+        << (sameOutput ? "identical" : "DIFFERS") << "\n";
+
+    // vectorised against scalar on the same front end, so that only the
+    // instruction set differs; first the block scan on its own, the part of
+    // parsing the vector instructions replace
+    bool fastEnough = true;
+    if (instructionSet != InstructionSet::SCALAR) {
+        volatile std::uint64_t structuralChars = 0;
+        const SpeedUp scanSpeedUp = measureSpeedUp([&buffer, &structuralChars]() {
+            std::uint64_t mask = 0;
+            for (size_t offset = 0; offset < buffer.size(); offset += StructuralScanner::k_blockSize) {
+                StructuralMasks masks = StructuralScanner::scanBlock(buffer.data() + offset,
+                    std::min<size_t>(buffer.size() - offset, StructuralScanner::k_blockSize));
+                mask ^= masks.m_spaces ^ masks.m_newlines;
+            }
+            structuralChars = mask;
+        }, buffer.size(), instructionSet);
+        std::cout << "block scan, bytes/s: scalar " << scanSpeedUp.m_scalarRate
+            << ", " << StructuralScanner::instructionSetToString(instructionSet) << " " << scanSpeedUp.m_vectorRate
+            << ", speed-up " << scanSpeedUp.m_speedUp << "x, at least " << k_minScanSpeedUp << "x expected\n";
+
+        const char* frontEndNames[] = { "line by line", "buffer", "listenToMessage" };
+        auto nullMatchingEngine = std::make_shared<NullMatchingEngine>();
+        MessageProcessor messageProcessor(nullMatchingEngine);
+        messageProcessor.reserve(0, 0, 32);
+        std::cout << "parse throughput, msg/s:\n";
+        SpeedUp bufferSpeedUp = { 0, 0, 0 };
+        for (int i = 0; i < 3; ++i) {
+            const FrontEnd frontEnd = frontEnds[i];
+            const SpeedUp parseSpeedUp = measureSpeedUp([&messageProcessor, &buffer, frontEnd]() {
+                parseMessages(messageProcessor, buffer, frontEnd);
+            }, stream.size(), instructionSet);
+            std::cout << "  " << frontEndNames[i] << ": scalar " << parseSpeedUp.m_scalarRate
+                << ", " << StructuralScanner::instructionSetToString(instructionSet) << " " << parseSpeedUp.m_vectorRate
+                << ", speed-up " << parseSpeedUp.m_speedUp << "x\n";
+            if (frontEnd == FrontEnd::BUFFER) {
+                bufferSpeedUp = parseSpeedUp;
+            }
+        }
+        std::cout << "  at least " << k_minParseSpeedUp << "x expected on the buffer\n";
+        fastEnough = scanSpeedUp.m_speedUp >= k_minScanSpeedUp && bufferSpeedUp.m_speedUp >= k_minParseSpeedUp;
+    }
+    else {
+        std::cout << "no vector instructions, speed-up not checked\n";
+    }
+    StructuralScanner::setInstructionSet(instructionSet);
+
+    bool passed = mismatches == 0 && sameOutput && fastEnough;
+    std::cout << "parse test: " << (passed ? "PASSED" : "FAILED") << "\n";
+    return passed;
+}
+
+
+/// <summary>
+/// replay messages on a fresh engine, keeping its output in output;
+/// returns the throughput in msg/s
+/// </summary>
+double replayMessages(const std::vector<std::string>& messages, std::string& output) {
+    MessageProcessor messageProcessor(std::make_shared<MatchingEngine>());
+    messageProcessor.reserve(messages.size(), 256, 32);
+
+    std::ostringstream os;
+    std::streambuf* coutBuffer = std::cout.rdbuf(os.rdbuf());
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& message : messages) {
+        messageProcessor.processMessage(message);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout.rdbuf(coutBuffer);
+
+    output = os.str();
+    return messages.size() / elapsed.count();
+}
+
+
+/// <summary>
+/// replay a synthetic stream with tracing off and with one in sampleEvery order
+/// messages traced into traceFile, comparing throughput; returns true if tracing
+/// didn't change the engine's output, every sampled message made it to a complete
+/// file, and an engine behind a ReplicationPrimary still records its own spans
+/// </summary>
+bool testOrderTracer(const std::string& traceFile, size_t sampleEvery) {
+    const size_t numMessages = 200000;
+    const int numPasses = 7;
+    std::vector<std::string> messages;
+    size_t numOrderMessages = 0;
+    for (auto& timedMessage : LoadGenerator::makeSyntheticStream(numMessages, 1e6, 42)) {
+        Token tokens[MessageProcessor::k_maxTokens];
+        size_t numTokens = MessageProcessor::tokenizeMessage(timedMessage.m_message, tokens, MessageProcessor::k_maxTokens);
+        numOrderMessages += MessageProcessor::isOrderMessage(tokens, numTokens) ? 1 : 0;
+        messages.push_back(std::move(timedMessage.m_message));
+    }
+
+    // untraced and traced passes alternate, so that load on the machine hits both
+    // alike; the overhead is the median of the pairs. Each traced pass writes the
+    // file anew and is checked before the next one
+    std::string untracedOutput;
+    std::string tracedOutput;
+    double untracedRate = 0;
+    double tracedRate = 0;
+    std::vector<double> overheads;
+    bool sameOutput = true;
+    bool complete = true;
+    size_t numTraces = 0;
+    size_t numSpans = 0;
+    size_t numDropped = 0;
+    for (int pass = 0; pass < numPasses; ++pass) {
+        double passUntracedRate = replayMessages(messages, untracedOutput);
+
+        if (!OrderTracer::start(traceFile, sampleEvery)) {
+            std::cout << "can't write trace file " << traceFile << "\n";
+            return false;
+        }
+        double passTracedRate = replayMessages(messages, tracedOutput);
+        OrderTracer::stop();
+
+        untracedRate = std::max(untracedRate, passUntracedRate);
+        tracedRate = std::max(tracedRate, passTracedRate);
+        overheads.push_back((passUntracedRate / passTracedRate - 1) * 100);
+        sameOutput = sameOutput && tracedOutput == untracedOutput;
+        numSpans += OrderTracer::numWrittenSpans();
+        numDropped = OrderTracer::numDroppedSpans();
+
+        // every sampled message ends in a message span
+        std::ifstream is(traceFile);
+        std::string trace((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+        for (size_t pos = trace.find("\"name\":\"message\""); pos != std::string::npos;
+            pos = trace.find("\"name\":\"message\"", pos + 1)) {
+            ++numTraces;
+        }
+        complete = complete && trace.size() >= 3 && trace.front() == '[' &&
+            trace.compare(trace.size() - 3, 3, "\n]\n") == 0;
+    }
+    std::sort(overheads.begin(), overheads.end());
+
+    // every sampled order goes through the wrapped engine's traced path; the
+    // primary has no backups, and stops taking commands once k_maxPendingBytes
+    // are pending, so only a few are replayed
+    bool wrappedSpans = false;
+    {
+        MessageProcessor messageProcessor(std::make_shared<ReplicationPrimary>(std::make_shared<MatchingEngine>()));
+        NullBuffer nullBuffer;
+        std::streambuf* coutBuffer = std::cout.rdbuf(&nullBuffer);
+        OrderTracer::start(traceFile, 1);
+        for (size_t i = 0; i < 500; ++i) {
+            messageProcessor.processMessage(messages[i]);
+        }
+        OrderTracer::stop();
+        std::cout.rdbuf(coutBuffer);
+
+        std::ifstream is(traceFile);
+        std::string trace((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+        wrappedSpans = trace.find("\"name\":\"validate\"") != std::string::npos;
+    }
+
+    // untraced passes don't count messages, so the sampling goes on across passes
+    const size_t expectedTraces = numPasses * numOrderMessages / sampleEvery;
+    std::cout << "trace file " << traceFile << ": " << numTraces << " sampled order messages of "
+        << expectedTraces << " expected over " << numPasses << " passes, " << numSpans << " spans, "
+        << numDropped << " dropped\n"
+        << "engine spans behind a replication primary: " << (wrappedSpans ? "yes" : "no") << "\n"
+        << "throughput, msg/s, best of " << numPasses << ": untraced " << untracedRate
+        << ", traced 1 in " << sampleEvery << " " << tracedRate << "\n"
+        << "overhead, median of " << numPasses << " interleaved pairs: "
+        << overheads[overheads.size() / 2] << "% (range " << overheads.front()
+        << "% to " << overheads.back() << "%)\n";
+
+    bool passed = sameOutput && complete && numTraces == expectedTraces && numDropped == 0 && wrappedSpans;
+    std::cout << "trace test: " << (passed ? "PASSED" : "FAILED") << "\n";
+    return passed;
+}
+
+
+/// <summary>
+/// fuzz MatchingEngine against the frozen reference engine with numRuns seeded
+/// streams, then compare their throughput; returns true if they agree
+/// </summary>
+bool testDifferentialFuzzer(size_t numRuns) {
+    DifferentialFuzzer differentialFuzzer(
+        []() { return std::make_shared<reference::ReferenceMatchingEngine>(); },
+        []() { return std::make_shared<MatchingEngine>(); });
+
+    bool agree = differentialFuzzer.run(1, numRuns, 2000, std::cout);
+    differentialFuzzer.compareThroughput(DifferentialFuzzer::makeCommands(0, 200000), std::cout);
+    return agree;
+}
+
+
+/// <summary>
+/// replay messages on a plain engine; returns the cost per message in ns
+/// </summary>
+double measureUnreplicated(const std::vector<std::string>& messages) {
+    MessageProcessor messageProcessor(std::make_shared<MatchingEngine>());
+    messageProcessor.reserve(messages.size(), 256, 32);
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& message : messages) {
+        messageProcessor.processMessage(message);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / messages.size();
+}
+
+
+/// <summary>
+/// replay messages through a primary with no backup connected, which leaves the
+/// hot path's own share of replication: sequencing, formatting and batching;
+/// returns the cost per message in ns, or 0 if port is unusable
+/// </summary>
+double measureReplicatedWithoutBackups(const std::vector<std::string>& messages, unsigned short port) {
+    auto replicationPrimary = std::make_shared<ReplicationPrimary>(std::make_shared<MatchingEngine>());
+    if (!replicationPrimary->listen(port)) {
+        return 0;
+    }
+    MessageProcessor messageProcessor(replicationPrimary);
+    messageProcessor.reserve(messages.size(), 256, 32);
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& message : messages) {
+        messageProcessor.processMessage(message);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / messages.size();
+}
+
+
+/// <summary>
+/// replay messages through a primary replicating to a backup on port, both in this
+/// process, optionally wait for the acks, then shut the primary down so that the
+/// backup takes over; nsPerMessage gets the primary's cost per message; returns
+/// the engines, or false if the backup couldn't be connected, broke off, refused
+/// to take over or missed commands
+/// </summary>
+bool replicateMessages(const std::vector<std::string>& messages,
+    unsigned short port,
+    bool waitForAcks,
+    std::shared_ptr<MatchingEngine>& primaryEngine,
+    std::shared_ptr<MatchingEngine>& backupEngine,
+    double& nsPerMessage) {
+    primaryEngine = std::make_shared<MatchingEngine>();
+    backupEngine = std::make_shared<MatchingEngine>();
+    backupEngine->reserve(messages.size(), 256, 32);
+
+    auto replicationPrimary = std::make_shared<ReplicationPrimary>(primaryEngine);
+    ReplicationBackup replicationBackup(backupEngine);
+    if (!replicationPrimary->listen(port)
+        || !replicationBackup.connect(port)
+        || !replicationPrimary->waitForBackups(1, std::chrono::seconds(5))) {
+        std::cerr << "can't connect a backup on port " << port << "\n";
+        return false;
+    }
+
+    bool consistent = false;
+    std::thread backupThread([&replicationBackup, &consistent]() { consistent = replicationBackup.run(); });
+
+    bool acked = true;
+    long long sequence;
+    {
+        MessageProcessor messageProcessor(replicationPrimary);
+        messageProcessor.reserve(messages.size(), 256, 32);
+        auto start = std::chrono::steady_clock::now();
+        for (const auto& message : messages) {
+            messageProcessor.processMessage(message);
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        nsPerMessage = elapsed.count() / messages.size();
+        if (waitForAcks) {
+            acked = replicationPrimary->waitForAcks(std::chrono::seconds(10));
+        }
+        sequence = replicationPrimary->sequence();
+    }
+
+    // the primary goes away, the backup sees the end of the stream and takes over;
+    // without waiting, acks are still in flight while the primary shuts down
+    replicationPrimary.reset();
+    backupThread.join();
+
+    if (!acked || !consistent || replicationBackup.appliedSequence() != sequence) {
+        std::cerr << "backup " << (!acked ? "didn't acknowledge" : consistent ? "missed commands" : "refused to take over")
+            << " after sequence " << replicationBackup.appliedSequence() << " of " << sequence << "\n";
+        return false;
+    }
+    return true;
+}
+
+
+/// <summary>
+/// returns what PRINT writes for matchingEngine
+/// </summary>
+std::string printBook(const MatchingEngine& matchingEngine) {
+    std::ostringstream os;
+    std::streambuf* coutBuffer = std::cout.rdbuf(os.rdbuf());
+    matchingEngine.print();
+    std::cout.rdbuf(coutBuffer);
+    return os.str();
+}
+
+
+/// <summary>
+/// replicate a synthetic stream to a backup over loopback, then fail over to it:
+/// check that its book equals the primary's and that it goes on exactly as the
+/// primary would, and compare the cost per message with and without replication;
+/// returns true if the backup's book and output match the primary's
+/// </summary>
+bool testReplication(unsigned short port) {
+    const size_t numMessages = 200000;
+    const size_t numMessagesAfterFailover = 20000;
+    const int numPasses = 3;
+    std::vector<std::string> messages;
+    for (auto& timedMessage : LoadGenerator::makeSyntheticStream(numMessages + numMessagesAfterFailover, 1e6, 42)) {
+        messages.push_back(std::move(timedMessage.m_message));
+    }
+    std::vector<std::string> messagesAfterFailover(messages.end() - numMessagesAfterFailover, messages.end());
+    messages.resize(numMessages);
+
+    // trade events of both engines are dropped, the books are compared instead;
+    // passes alternate, so that load on the machine hits both alike
+    NullBuffer nullBuffer;
+    std::streambuf* coutBuffer = std::cout.rdbuf(&nullBuffer);
+    double unreplicatedNs = 0;
+    double hotPathNs = 0;
+    double replicatedNs = 0;
+    std::shared_ptr<MatchingEngine> primaryEngine;
+    std::shared_ptr<MatchingEngine> backupEngine;
+    bool replicated = true;
+    for (int pass = 0; pass < numPasses && replicated; ++pass) {
+        double ns = measureUnreplicated(messages);
+        unreplicatedNs = pass == 0 ? ns : std::min(unreplicatedNs, ns);
+        ns = measureReplicatedWithoutBackups(messages, port);
+        hotPathNs = pass == 0 ? ns : std::min(hotPathNs, ns);
+        replicated = replicateMessages(messages, port, true, primaryEngine, backupEngine, ns);
+        replicatedNs = pass == 0 ? ns : std::min(replicatedNs, ns);
+    }
+
+    // a primary shutting down right after the last command, with acks unread,
+    // must still leave the backup the whole stream and let it take over
+    std::shared_ptr<MatchingEngine> shutdownPrimaryEngine;
+    std::shared_ptr<MatchingEngine> shutdownBackupEngine;
+    double shutdownNs;
+    const bool shutdownReplicated = replicated
+        && replicateMessages(messages, port, false, shutdownPrimaryEngine, shutdownBackupEngine, shutdownNs);
+    std::cout.rdbuf(coutBuffer);
+    if (!replicated || !shutdownReplicated) {
+        std::cout << "replication test: FAILED\n";
+        return false;
+    }
+
+    const bool sameBook = printBook(*primaryEngine) == printBook(*backupEngine)
+        && printBook(*shutdownPrimaryEngine) == printBook(*shutdownBackupEngine);
+
+    // the promoted backup must go on exactly as the primary would have
+    std::string outputs[2];
+    std::shared_ptr<MatchingEngine> engines[2] = { primaryEngine, backupEngine };
+    for (int i = 0; i < 2; ++i) {
+        std::ostringstream os;
+        coutBuffer = std::cout.rdbuf(os.rdbuf());
+        MessageProcessor messageProcessor(engines[i]);
+        for (const auto& message : messagesAfterFailover) {
+            messageProcessor.processMessage(message);
+        }
+        engines[i]->print();
+        std::cout.rdbuf(coutBuffer);
+        outputs[i] = os.str();
+    }
+    const bool sameAfterFailover = outputs[0] == outputs[1];
+
+    std::cout << "backup book after " << numMessages << " messages, with and without waiting for acks: "
+        << (sameBook ? "equal" : "DIFFERENT")
+        << ", after failover and " << numMessagesAfterFailover << " more: "
+        << (sameAfterFailover ? "equal" : "DIFFERENT") << "\n"
+        << "primary cost per message, ns: unreplicated " << unreplicatedNs
+        << ", replicating with no backup " << hotPathNs
+        << " (hot path adds " << hotPathNs - unreplicatedNs << ")"
+        << ", replicating to the backup " << replicatedNs
+        << " (adds " << replicatedNs - unreplicatedNs << ")\n";
+    if (std::thread::hardware_concurrency() < 3) {
+        // primary, sender and backup threads take turns on the same cores
+        std::cout << "only " << std::thread::hardware_concurrency()
+            << " hardware thread(s), the cost with the backup includes the backup's and the sender's work\n";
+    }
+
+    bool passed = sameBook && sameAfterFailover;
+    std::cout << "replication test: " << (passed ? "PASSED" : "FAILED") << "\n";
+    return passed;
+}
+
+
+/// <summary>
+/// run as replication primary: wait for numBackups backups on port, then execute
+/// messages from std::cin and replicate them; returns false if port is unusable
+/// </summary>
+bool runPrimary(unsigned short port, size_t numBackups) {
+    auto replicationPrimary = std::make_shared<ReplicationPrimary>(std::make_shared<MatchingEngine>());
+    if (!replicationPrimary->listen(port)) {
+        std::cerr << "cannot listen on port " << port << "\n";
+        return false;
+    }
+
+    std::cerr << "waiting for " << numBackups << " backups on port " << port << "\n";
+    while (!replicationPrimary->waitForBackups(numBackups, std::chrono::seconds(1))) {
+    }
+
+    MessageProcessor messageProcessor(replicationPrimary);
+    messageProcessor.listenToMessage(std::cin);
+    return true;
+}
+
+
+/// <summary>
+/// run as replication backup of the primary on port; when the primary goes away
+/// take over with the replicated book and execute messages from std::cin;
+/// returns false if the book couldn't be replicated
+/// </summary>
+bool runBackup(unsigned short port) {
+    auto matchingEngine = std::make_shared<MatchingEngine>();
+    ReplicationBackup replicationBackup(matchingEngine);
+    if (!replicationBackup.connect(port)) {
+        std::cerr << "cannot connect to primary on port " << port << "\n";
+        return false;
+    }
+
+    // trade events are the primary's to report while it is alive
+    NullBuffer nullBuffer;
+    std::streambuf* coutBuffer = std::cout.rdbuf(&nullBuffer);
+    bool consistent = replicationBackup.run();
+    std::cout.rdbuf(coutBuffer);
+
+    if (!consistent) {
+        std::cerr << "sequence gap or dropped by the primary after " << replicationBackup.appliedSequence()
+            << ", not taking over\n";
+        return false;
+    }
+
+    std::cerr << "primary gone after sequence " << replicationBackup.appliedSequence() << ", taking over\n";
+    MessageProcessor messageProcessor(matchingEngine);
+    messageProcessor.listenToMessage(std::cin);
+    return true;
+}
+
+
+int main(int argc, char* argv[])
 {
+    // std::cin gets a buffer of its own, which listenToMessage parses in one go
+    // when messages arrive faster than they are handled
+    std::ios::sync_with_stdio(false);
+
+#ifdef MATCHINGENGINE_COUNT_ALLOCATIONS
+    if (argc > 1 && std::string(argv[1]) == "--zero-alloc-test") {
+        return testZeroAllocation() ? 0 : 1;
+    }
+#endif
+
+    if (argc > 1 && std::string(argv[1]) == "--memory-test") {
+        return testMemoryAccounting() ? 0 : 1;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--parse-test") {
+        return testStructuralScanner(argc > 2 ? argv[2] : "") ? 0 : 1;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--trace-test") {
+        return testOrderTracer(argc > 2 ? argv[2] : "order_trace.json", argc > 3 ? std::stoul(argv[3]) : 100) ? 0 : 1;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--load-test") {
+        return testLoadGenerator(argc > 2 ? argv[2] : "") ? 0 : 1;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--fuzz") {
+        return testDifferentialFuzzer(argc > 2 ? std::stoul(argv[2]) : 100) ? 0 : 1;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--replication-test") {
+        return testReplication(static_cast<unsigned short>(argc > 2 ? std::stoi(argv[2]) : 17001)) ? 0 : 1;
+    }
+
+    if (argc > 3 && std::string(argv[1]) == "--primary") {
+        return runPrimary(static_cast<unsigned short>(std::stoi(argv[2])), std::stoul(argv[3])) ? 0 : 1;
+    }
+
+    if (argc > 2 && std::string(argv[1]) == "--backup") {
+        return runBackup(static_cast<unsigned short>(std::stoi(argv[2]))) ? 0 : 1;
+    }
+
     std::cout << "Begin Test!\n\n";
 
     //testTokenizer();